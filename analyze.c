@@ -0,0 +1,296 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+// Needed for getopt_long().
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hist.h"
+#include "samplelog.h"
+
+#define PRECISION 3
+
+/**
+ * @brief A sample of any thread, with times in nanoseconds.
+ */
+struct point {
+	uint64_t sent;    /**< Send time since the origin.         */
+	uint64_t latency; /**< Round-trip time.                    */
+	uint32_t run;     /**< Run the sample belongs to.          */
+};
+
+/**
+ * @brief Samples of every log, in run order and then in send order.
+ */
+struct points {
+	struct point *p; /**< Samples.            */
+	size_t n;        /**< Number of samples.  */
+};
+
+/*====================================================================================================================*
+ * points_load()                                                                                                      *
+ *====================================================================================================================*/
+
+/**
+ * @brief Appends the samples of a log, converted to nanoseconds.
+ *
+ * @param pts  Target samples.
+ * @param path Path to the log.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int points_load(struct points *pts, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	const struct sample_log_hdr *hdr = NULL;
+	const struct sample *samples = NULL;
+	struct point *p = NULL;
+	void *map = NULL;
+	double ns_per_tick = 0;
+	uint64_t overhead = 0;
+
+	if (fd < 0)
+		return (-1);
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct sample_log_hdr))
+		goto fail;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	hdr = map;
+	samples = (const struct sample *)(hdr + 1);
+	if (memcmp(hdr->magic, SAMPLE_LOG_MAGIC, sizeof(hdr->magic)) != 0 || hdr->sample_size != sizeof(struct sample) ||
+	    hdr->tsc_hz == 0 || sizeof(struct sample_log_hdr) + hdr->count * sizeof(struct sample) > (size_t)st.st_size)
+	{
+		munmap(map, st.st_size);
+		goto fail;
+	}
+
+	p = realloc(pts->p, (pts->n + hdr->count) * sizeof(struct point));
+	if (p == NULL && pts->n + hdr->count > 0)
+	{
+		munmap(map, st.st_size);
+		goto fail;
+	}
+	pts->p = p;
+	ns_per_tick = 1e9 / hdr->tsc_hz;
+	overhead = hdr->overhead;
+	for (uint64_t i = 0; i < hdr->count; i++)
+	{
+		/* Latencies were taken with two readings of the TSC, as in the client. */
+		uint64_t latency = (samples[i].latency > overhead) ? samples[i].latency - overhead : 0;
+
+		pts->p[pts->n].sent = (uint64_t)(samples[i].sent * ns_per_tick);
+		pts->p[pts->n].latency = (uint64_t)(latency * ns_per_tick);
+		pts->p[pts->n++].run = samples[i].run;
+	}
+	munmap(map, st.st_size);
+	close(fd);
+	return (0);
+
+fail:
+	close(fd);
+	return (-1);
+}
+
+/**
+ * @brief Orders samples by run, then by send time.
+ */
+static int point_cmp(const void *a, const void *b)
+{
+	const struct point *x = a, *y = b;
+
+	if (x->run != y->run)
+		return ((x->run < y->run) ? -1 : 1);
+	if (x->sent != y->sent)
+		return ((x->sent < y->sent) ? -1 : 1);
+	return (0);
+}
+
+/*====================================================================================================================*
+ * report_run()                                                                                                       *
+ *====================================================================================================================*/
+
+/**
+ * @brief Prints the column names of run summaries. Latencies are in nanoseconds.
+ */
+static void report_header(void)
+{
+	printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "run", "msgs", "msgs/s", "mean", "p50", "p90",
+	       "p99", "p99.9", "p99.99", "max");
+}
+
+/**
+ * @brief Prints the latency summary of a run.
+ *
+ * @param run Samples of the run, in send order.
+ * @param n   Number of samples.
+ * @param h   Scratch histogram.
+ */
+static void report_run(const struct point *run, size_t n, struct hist *h)
+{
+	uint64_t span = run[n - 1].sent - run[0].sent;
+
+	hist_reset(h);
+	for (size_t i = 0; i < n; i++)
+		hist_record(h, run[i].latency);
+	printf("%8u %10lu %10.0f %10lu %10lu %10lu %10lu %10lu %10lu %10lu\n", run[0].run, h->count,
+	       (span > 0) ? (double)(n - 1) * 1e9 / span : 0, h->sum / h->count, hist_percentile(h, 50),
+	       hist_percentile(h, 90), hist_percentile(h, 99), hist_percentile(h, 99.9), hist_percentile(h, 99.99),
+	       h->max);
+}
+
+/**
+ * @brief Prints the cumulative distribution of latency in a run, at every percent and in the tail.
+ *
+ * @param h Histogram of the run, as left by report_run().
+ * @param r Number of the run.
+ */
+static void report_cdf(const struct hist *h, uint32_t r)
+{
+	static const double tail[] = {99.5, 99.9, 99.95, 99.99, 99.999};
+
+	for (unsigned p = 1; p <= 99; p++)
+		printf("%8u %10.3f %10lu\n", r, (double)p, hist_percentile(h, p));
+	for (unsigned i = 0; i < sizeof(tail) / sizeof(tail[0]); i++)
+		printf("%8u %10.3f %10lu\n", r, tail[i], hist_percentile(h, tail[i]));
+	printf("%8u %10.3f %10lu\n", r, 100.0, h->max);
+}
+
+/**
+ * @brief Prints the latency of a run over time, by send time.
+ *
+ * @param run   Samples of the run, in send order.
+ * @param n     Number of samples.
+ * @param width Width of a window in nanoseconds.
+ * @param h     Scratch histogram.
+ */
+static void report_windows(const struct point *run, size_t n, uint64_t width, struct hist *h)
+{
+	size_t i = 0;
+
+	for (uint64_t start = run[0].sent; i < n; start += width)
+	{
+		hist_reset(h);
+		for (; i < n && run[i].sent < start + width; i++)
+			hist_record(h, run[i].latency);
+		printf("%8u %10.1f %10lu %10lu %10lu %10lu %10lu\n", run[0].run, (double)(start - run[0].sent) / 1e6,
+		       h->count, (h->count > 0) ? h->sum / h->count : 0, (h->count > 0) ? hist_percentile(h, 50) : 0,
+		       (h->count > 0) ? hist_percentile(h, 99) : 0, h->max);
+	}
+}
+
+/*====================================================================================================================*
+ * usage()                                                                                                            *
+ *====================================================================================================================*/
+
+/**
+ * @brief Prints program usage.
+ *
+ * @param progname Program name.
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options] sample-log...\n", progname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --cdf                     Print the latency distribution of each run.\n");
+	fprintf(stderr, "  --interval=MS             Print latency over time in windows of MS milliseconds.\n");
+	fprintf(stderr, "  --run=N                   Only analyze run N (default: all).\n");
+}
+
+/*====================================================================================================================*
+ * main()                                                                                                             *
+ *====================================================================================================================*/
+
+static const struct option long_options[] = {
+	{"cdf", no_argument, NULL, 'c'},
+	{"interval", required_argument, NULL, 'n'},
+	{"run", required_argument, NULL, 'r'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0},
+};
+
+int main(int argc, char *const argv[])
+{
+	struct points pts = {0};
+	struct hist h;
+	int cdf = 0;
+	unsigned interval_ms = 0;
+	long only = -1;
+	int opt = -1;
+
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			cdf = 1;
+			break;
+		case 'n':
+			sscanf(optarg, "%u", &interval_ms);
+			break;
+		case 'r':
+			sscanf(optarg, "%ld", &only);
+			break;
+		default:
+			usage(argv[0]);
+			return (EXIT_FAILURE);
+		}
+	}
+	if (optind == argc)
+	{
+		usage(argv[0]);
+		return (EXIT_FAILURE);
+	}
+
+	for (int i = optind; i < argc; i++)
+	{
+		if (points_load(&pts, argv[i]) != 0)
+		{
+			fprintf(stderr, "%s: not a sample log\n", argv[i]);
+			return (EXIT_FAILURE);
+		}
+	}
+	qsort(pts.p, pts.n, sizeof(struct point), point_cmp);
+	assert(hist_init(&h, PRECISION) == 0);
+
+	for (size_t first = 0, last = 0; first < pts.n; first = last)
+	{
+		for (last = first; last < pts.n && pts.p[last].run == pts.p[first].run; last++)
+			;
+		if (only >= 0 && pts.p[first].run != only)
+			continue;
+		/* Repeat column names when runs are followed by tables of their own. */
+		if (first == 0 || only >= 0 || cdf || interval_ms > 0)
+			report_header();
+		report_run(&pts.p[first], last - first, &h);
+		if (cdf)
+		{
+			printf("%8s %10s %10s\n", "run", "pct", "latency");
+			report_cdf(&h, pts.p[first].run);
+		}
+		if (interval_ms > 0)
+		{
+			printf("%8s %10s %10s %10s %10s %10s %10s\n", "run", "t (ms)", "msgs", "mean", "p50", "p99", "max");
+			report_windows(&pts.p[first], last - first, (uint64_t)interval_ms * 1000 * 1000, &h);
+		}
+	}
+
+	hist_destroy(&h);
+	free(pts.p);
+	return (EXIT_SUCCESS);
+}
@@ -5,10 +5,20 @@
 // Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
 // See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
 #define _POSIX_C_SOURCE 200809L
+// Needed for CPU affinity.
+#define _GNU_SOURCE
 
 #include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 
 #include "demi/libos.h"
@@ -16,171 +26,2241 @@
 #include "demi/wait.h"
 
 #include "common.h"
+#include "hist.h"
+#include "msg.h"
+#include "samplelog.h"
+#include "series.h"
+#include "sgapool.h"
+#include "sizedist.h"
+#include "summary.h"
+#include "trace.h"
+#include "transport.h"
+#include "tsc.h"
 
 #define DATA_SIZE 64
 #define MAX_MSGS  (1024*1024)
+#define INFLIGHT  32
+#define MIN_DEPTH 1
+#define MAX_DEPTH 256
+#define MAX_CORES 256
+#define PRECISION 3
+#define POOL_SIZE 256
+#define TIMEOUT   1000
+#define SPIN_US   50
+#define BATCH     32
 
-#include <sys/types.h>
-#include <x86intrin.h>
-static inline
-time_t read_tsc(void) {
-	_mm_lfence();  // optionally wait for earlier insns to retire before reading the clock
-	time_t tsc = __rdtsc();
-	_mm_lfence();  // optionally block later instructions until rdtsc retires
-	return tsc;
+/* How often blocking waits check whether the run has been asked to stop. */
+#define STOP_CHECK_NS (100 * 1000 * 1000)
+
+/* Number of times per timeout period that outstanding requests are checked for expiry. */
+#define TIMEOUT_SCANS 8
+
+/* Number of time-series windows kept when the length of a run is not known in advance. */
+#define SERIES_WINDOWS 4096
+
+/**
+ * @brief How requests are issued.
+ */
+enum client_mode {
+	MODE_CLOSED,   /**< One request at a time, next one sent when the echo arrives. */
+	MODE_OPEN,     /**< Requests sent at a fixed rate regardless of echoes.          */
+	MODE_PIPELINE, /**< A fixed number of requests kept outstanding.                 */
+	MODE_REPLAY,   /**< Requests sent at the times and sizes of a captured trace.    */
+};
+
+/**
+ * @brief Distribution of inter-arrival times in open-loop mode.
+ */
+enum arrival_dist {
+	ARRIVAL_CONST,   /**< Constant inter-arrival time.      */
+	ARRIVAL_POISSON, /**< Exponential inter-arrival times.  */
+};
+
+/**
+ * @brief How the client waits for operations to complete.
+ */
+enum wait_strategy {
+	WAIT_BLOCK,  /**< Block in the libOS until something completes.                      */
+	WAIT_SPIN,   /**< Poll with a zero timeout until something completes.                */
+	WAIT_HYBRID, /**< Poll for a while, then block.                                      */
+	WAIT_BATCH,  /**< Block, then take every completion already in before issuing more. */
+};
+
+/* Names of the wait strategies, as given on the command line. */
+static const char *const wait_names[] = {"block", "spin", "hybrid", "batch"};
+
+/**
+ * @brief Parameters of a run.
+ */
+struct client_config {
+	size_t data_size;          /**< Number of bytes in each message.               */
+	size_t min_size;           /**< First message size of a sweep.                 */
+	size_t max_size;           /**< Last message size of a sweep.                  */
+	const struct size_dist *dist; /**< Message sizes, NULL for data-size only.     */
+	const struct trace *trace; /**< Requests to replay (replay).                   */
+	double speed;              /**< Replay speed, 2 to replay twice as fast.       */
+	unsigned co_interval;      /**< Expected send interval in ns, 0 for p50.       */
+	unsigned max_msgs;         /**< Number of messages to transfer.                */
+	enum client_mode mode;     /**< How requests are issued.                       */
+	double rate;               /**< Offered load in requests per second (open).    */
+	enum arrival_dist arrival; /**< Inter-arrival time distribution (open).        */
+	unsigned inflight;         /**< Maximum number of outstanding requests (open). */
+	unsigned min_depth;        /**< First pipeline depth (pipeline).               */
+	unsigned max_depth;        /**< Last pipeline depth (pipeline).                */
+	unsigned conns;            /**< Number of connections per thread.              */
+	unsigned threads;          /**< Number of worker threads.                      */
+	int cores[MAX_CORES];      /**< Cores to pin worker threads to.                */
+	unsigned ncores;           /**< Number of cores to pin worker threads to.      */
+	unsigned precision;        /**< Significant digits kept in latency histograms. */
+	unsigned pool_size;        /**< Preallocated scatter-gather arrays per thread. */
+	enum framing framing;      /**< How echoes are delimited.                      */
+	int stamp;                 /**< Take latency and sequence from echoed headers. */
+	unsigned timeout_ms;       /**< Time to wait for an echo, 0 for no limit.      */
+	unsigned max_timeouts;     /**< Timeouts before aborting, 0 for no limit.      */
+	double warmup;             /**< Seconds before sampling starts.                */
+	double duration;           /**< Seconds sampled, 0 to run by message count.    */
+	double cooldown;           /**< Seconds of load after sampling ends.           */
+	unsigned interval_ms;      /**< Width of time-series windows, 0 for none.      */
+	int live;                  /**< Print time-series windows as they close.       */
+	const char *sample_path;   /**< Binary log of every sample, NULL for none.     */
+	uint64_t log_origin;       /**< TSC value logged send times are relative to.   */
+	enum wait_strategy wait;   /**< How to wait for completions.                   */
+	unsigned spin_us;          /**< Microseconds of polling before blocking.       */
+	unsigned wait_batch;       /**< Completions taken per wake-up (batch).         */
+	struct summary *summary;   /**< Machine-readable results, NULL for none.       */
+};
+
+/*====================================================================================================================*
+ * rng_uniform()                                                                                                      *
+ *====================================================================================================================*/
+
+static __thread uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+/**
+ * @brief Draws a uniformly distributed number in (0, 1] (xorshift64*).
+ */
+static double rng_uniform(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (((rng_state * 0x2545f4914f6cdd1dull) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Draws the time until the next request is due.
+ *
+ * @param arrival Inter-arrival time distribution.
+ * @param mean    Mean inter-arrival time in TSC ticks.
+ *
+ * @return Inter-arrival time in TSC ticks.
+ */
+static double next_interarrival(enum arrival_dist arrival, double mean)
+{
+	if (arrival == ARRIVAL_POISSON)
+		return (-log(rng_uniform()) * mean);
+	return (mean);
+}
+
+/*====================================================================================================================*
+ * window_open()                                                                                                      *
+ *====================================================================================================================*/
+
+/**
+ * @brief Phases of a run, in TSC ticks.
+ *
+ * Requests sent during the warmup and the cooldown load the server but are
+ * not sampled, so that the measurement window sees a steady state.
+ */
+struct window {
+	uint64_t begin; /**< First send time that is sampled.                  */
+	uint64_t end;   /**< Send times from here on are not sampled.          */
+	uint64_t stop;  /**< No request is sent from here on, zero for never.  */
+};
+
+/**
+ * @brief Lays out the phases of a run starting now.
+ *
+ * @param cfg   Run parameters.
+ * @param start TSC value at which the run starts.
+ *
+ * @return Phases of the run. Without a duration, sampling goes on until the last message.
+ */
+static struct window window_open(const struct client_config *cfg, uint64_t start)
+{
+	struct window win = {0};
+
+	win.begin = start + (uint64_t)(cfg->warmup * tsc_hz());
+	if (cfg->duration > 0)
+	{
+		win.end = win.begin + (uint64_t)(cfg->duration * tsc_hz());
+		win.stop = win.end + (uint64_t)(cfg->cooldown * tsc_hz());
+	}
+	else
+	{
+		win.end = UINT64_MAX;
+		win.stop = 0;
+	}
+	return (win);
+}
+
+/**
+ * @brief Tells whether a request sent at a given time is sampled.
+ */
+static inline int window_has(const struct window *win, uint64_t sent)
+{
+	return (sent >= win->begin && sent < win->end);
+}
+
+/**
+ * @brief Tells whether requests may still be sent at a given time.
+ */
+static inline int window_open_at(const struct window *win, uint64_t now)
+{
+	return (win->stop == 0 || now < win->stop);
+}
+
+/**
+ * @brief Returns how much of the measurement window had elapsed at a given time.
+ */
+static uint64_t window_elapsed(const struct window *win, uint64_t now)
+{
+	if (now <= win->begin)
+		return (0);
+	return (((now < win->end) ? now : win->end) - win->begin);
+}
+
+/**
+ * @brief Sets up a latency time series for the runs of a thread.
+ *
+ * The ring holds the whole run when its length is known, SERIES_WINDOWS
+ * windows otherwise.
+ *
+ * @param s   Target series.
+ * @param cfg Run parameters.
+ * @param id  Number of the thread.
+ */
+static void series_setup(struct series *s, const struct client_config *cfg, unsigned id)
+{
+	size_t capacity = SERIES_WINDOWS;
+
+	if (cfg->interval_ms > 0 && cfg->duration > 0)
+		capacity = (size_t)((cfg->warmup + cfg->duration + cfg->cooldown) * 1000 / cfg->interval_ms) + 2;
+	assert(series_init(s, (uint64_t)cfg->interval_ms * tsc_hz() / 1000, capacity) == 0);
+	snprintf(s->label, sizeof(s->label), "t%u", id);
+	s->live = cfg->live ? stderr : NULL;
+}
+
+/**
+ * @brief Opens the sample log of a thread, if samples are to be logged.
+ *
+ * With several threads, each writes its own log, suffixed with the number
+ * of the thread.
+ *
+ * @param l   Target log.
+ * @param cfg Run parameters.
+ * @param id  Number of the thread.
+ */
+static void sample_log_setup(struct sample_log *l, const struct client_config *cfg, unsigned id)
+{
+	char path[4096];
+
+	if (cfg->sample_path != NULL && cfg->threads > 1)
+		snprintf(path, sizeof(path), "%s.%u", cfg->sample_path, id);
+	else if (cfg->sample_path != NULL)
+		snprintf(path, sizeof(path), "%s", cfg->sample_path);
+	if (sample_log_open(l, (cfg->sample_path != NULL) ? path : NULL, id, cfg->log_origin) != 0)
+	{
+		perror(path);
+		abort();
+	}
+}
+
+/**
+ * @brief Completes the sample log of a thread and warns about samples that did not fit.
+ *
+ * @param l Target log.
+ */
+static void sample_log_finish(struct sample_log *l)
+{
+	if (l->dropped > 0)
+		fprintf(stderr, "warning: thread %u could not log %lu samples\n", l->thread, l->dropped);
+	sample_log_close(l);
+}
+
+/**
+ * @brief Prints the windows of a latency time series, if any.
+ *
+ * @param s   Target series.
+ * @param now TSC value at which the run ended.
+ */
+static void report_series(struct series *s, uint64_t now)
+{
+	if (s->width == 0)
+		return;
+	series_close(s, now);
+	series_print(s, stdout);
+}
+
+/*====================================================================================================================*
+ * wait_any_until()                                                                                                   *
+ *====================================================================================================================*/
+
+/**
+ * @brief Returns the TSC value a given number of ticks from now, or zero (no deadline) if @p ticks is zero.
+ */
+static uint64_t deadline_after(uint64_t ticks)
+{
+	return ((ticks != 0) ? read_tsc() + ticks : 0);
+}
+
+/* How wait_any_until() waits, set before any connection opens. */
+static enum wait_strategy wait_strategy = WAIT_BLOCK;
+
+/* Ticks of polling before blocking, with WAIT_HYBRID. */
+static uint64_t wait_spin = 0;
+
+/**
+ * @brief Waits for the first operation in a list to complete, until a deadline or until the run is asked to stop.
+ *
+ * Blocking waits are sliced, so that a signal is noticed even if nothing ever
+ * completes. With WAIT_SPIN the libOS is polled with a zero timeout instead,
+ * and with WAIT_HYBRID it is polled for wait_spin ticks before blocking.
+ *
+ * @param qr_out       Storage location for operation result.
+ * @param ready_offset Storage location for the offset of the completed operation.
+ * @param qts          Operations to wait for.
+ * @param num_qts      Number of operations to wait for.
+ * @param deadline     TSC value at which to give up, zero to wait for as long as it takes.
+ *
+ * @return Zero if an operation completed, ETIMEDOUT if the deadline passed, ECANCELED if the run was asked to stop.
+ */
+static int wait_any_until(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts,
+			  uint64_t deadline)
+{
+	uint64_t spin_end = 0;
+
+	/* Poll until this point, block afterwards. */
+	if (wait_strategy == WAIT_SPIN)
+		spin_end = UINT64_MAX;
+	else if (wait_strategy == WAIT_HYBRID)
+		spin_end = read_tsc() + wait_spin;
+
+	for (;;)
+	{
+		struct timespec slice = {0, STOP_CHECK_NS};
+		uint64_t now = read_tsc();
+		int ret = 0;
+
+		if (deadline != 0)
+		{
+			if (now >= deadline)
+				return (ETIMEDOUT);
+			if (tsc_to_ns(deadline - now) < STOP_CHECK_NS)
+				slice.tv_nsec = tsc_to_ns(deadline - now);
+		}
+		if (now < spin_end)
+			slice.tv_nsec = 0;
+
+		ret = transport->wait_any(qr_out, ready_offset, qts, num_qts, &slice);
+		if (ret != ETIMEDOUT)
+		{
+			assert(ret == 0);
+			return (0);
+		}
+		if (stop_requested)
+			return (ECANCELED);
+	}
+}
+
+/*====================================================================================================================*
+ * connect_wait()                                                                                                     *
+ *====================================================================================================================*/
+
+/**
+ * @brief Connects to a remote socket and waits for operation to complete.
+ *
+ * @param qd      Target queue descriptor.
+ * @param saddr   Remote socket address.
+ * @param timeout Ticks to wait for before giving up, zero to wait for as long as it takes.
+ *
+ * @return Zero if the connection was established, ECONNREFUSED if it failed, ETIMEDOUT if it did not complete
+ * in time, ECANCELED if the run was asked to stop.
+ */
+static int connect_wait(int qd, const struct sockaddr_in *saddr, uint64_t timeout)
+{
+	demi_qtoken_t qt = -1;
+	demi_qresult_t qr = {0};
+	int offset = -1;
+	int ret = 0;
+
+	/* Connect to remote */
+	assert(transport->connect(&qt, qd, (const struct sockaddr *)saddr, sizeof(struct sockaddr_in)) == 0);
+
+	/* Wait for operation to complete. */
+	if ((ret = wait_any_until(&qr, &offset, &qt, 1, deadline_after(timeout))) != 0)
+		return (ret);
+
+	/* Parse operation result. */
+	return ((qr.qr_opcode == DEMI_OPC_CONNECT) ? 0 : ECONNREFUSED);
+}
+
+/*====================================================================================================================*
+ * push_wait()                                                                                                        *
+ *====================================================================================================================*/
+
+/**
+ * @brief Pushes a scatter-gather array to a remote socket and waits for operation to complete.
+ *
+ * @param qd       Target queue descriptor.
+ * @param sga      Target scatter-gather array.
+ * @param qr       Storage location for operation result.
+ * @param deadline TSC value at which to give up, zero for none.
+ *
+ * @return Zero if the operation completed, ECONNRESET if it failed, ETIMEDOUT if the deadline passed, ECANCELED if
+ * the run was asked to stop.
+ */
+static int push_wait(int qd, demi_sgarray_t *sga, demi_qresult_t *qr, uint64_t deadline)
+{
+	demi_qtoken_t qt = -1;
+	int offset = -1;
+	int ret = 0;
+
+	/* Push data. */
+	assert(transport->push(&qt, qd, sga) == 0);
+
+	/* Wait push operation to complete. */
+	if ((ret = wait_any_until(qr, &offset, &qt, 1, deadline)) != 0)
+		return (ret);
+
+	/* Parse operation result. */
+	if (qr->qr_opcode == DEMI_OPC_FAILED)
+		return (ECONNRESET);
+	assert(qr->qr_opcode == DEMI_OPC_PUSH);
+	return (0);
+}
+
+/*====================================================================================================================*
+ * pop_wait()                                                                                                         *
+ *====================================================================================================================*/
+
+/**
+ * @brief Pops a scatter-gather array and waits for operation to complete.
+ *
+ * @param qd       Target queue descriptor.
+ * @param qr       Storage location for operation result.
+ * @param deadline TSC value at which to give up, zero for none.
+ *
+ * @return Zero if data arrived, ECONNRESET if the operation failed or the server closed the connection, ETIMEDOUT
+ * if the deadline passed, ECANCELED if the run was asked to stop.
+ */
+static int pop_wait(int qd, demi_qresult_t *qr, uint64_t deadline)
+{
+	demi_qtoken_t qt = -1;
+	int offset = -1;
+	int ret = 0;
+
+	/* Pop data. */
+	assert(transport->pop(&qt, qd) == 0);
+
+	/* Wait for pop operation to complete. */
+	if ((ret = wait_any_until(qr, &offset, &qt, 1, deadline)) != 0)
+		return (ret);
+
+	/* Parse operation result. */
+	if (qr->qr_opcode == DEMI_OPC_FAILED)
+		return (ECONNRESET);
+	assert(qr->qr_opcode == DEMI_OPC_POP);
+	assert(qr->qr_value.sga.sga_segs != 0);
+
+	/* An empty pop means that the server closed the connection. */
+	if (qr->qr_value.sga.sga_segs[0].sgaseg_len == 0)
+	{
+		assert(transport->sgafree(&qr->qr_value.sga) == 0);
+		return (ECONNRESET);
+	}
+	return (0);
+}
+
+/*====================================================================================================================*
+ * conn_open()                                                                                                        *
+ *====================================================================================================================*/
+
+/**
+ * @brief Requests given up on, and what was done about them.
+ */
+struct error_stats {
+	uint64_t timeouts;   /**< Requests whose echo did not arrive in time.           */
+	uint64_t failed;     /**< Requests lost to a connection reset or closed.       */
+	uint64_t malformed;  /**< Requests whose connection carried malformed echoes.  */
+	uint64_t reconnects; /**< Connections reopened after a timeout or a failure.   */
+};
+
+/**
+ * @brief Opens a socket and connects it to a remote socket.
+ *
+ * @param qd_out  Storage location for the socket I/O queue descriptor.
+ * @param remote  Remote socket address.
+ * @param timeout Ticks to wait for the connection before giving up, zero for no limit.
+ *
+ * @return Zero on success, or the error returned by connect_wait(), in which case the socket is closed.
+ */
+static int conn_open(int *qd_out, const struct sockaddr_in *remote, uint64_t timeout)
+{
+	int ret = 0;
+
+	/* Setup socket. */
+	assert(transport->socket(qd_out, AF_INET, SOCK_STREAM, 0) == 0);
+
+	/* Connect to server. */
+	if ((ret = connect_wait(*qd_out, remote, timeout)) != 0)
+		transport->close(*qd_out);
+	return (ret);
+}
+
+/**
+ * @brief Accounts for requests given up on and tells whether the run should go on.
+ *
+ * @param errors       Error counters.
+ * @param err          Why they were given up on: ETIMEDOUT, ECONNRESET if their connection failed, or EPROTO if
+ *                     it carried malformed echoes.
+ * @param n            Number of requests given up on.
+ * @param max_timeouts Number of requests given up on after which the run is aborted, zero for no limit.
+ *
+ * @return Zero if the run should go on, ECANCELED if it was aborted.
+ */
+static int count_errors(struct error_stats *errors, int err, uint64_t n, uint64_t max_timeouts)
+{
+	uint64_t total = 0;
+
+	if (err == ETIMEDOUT)
+		errors->timeouts += n;
+	else if (err == EPROTO)
+		errors->malformed += n;
+	else
+		errors->failed += n;
+	total = errors->timeouts + errors->failed + errors->malformed;
+	if (max_timeouts != 0 && total >= max_timeouts)
+	{
+		if (!stop_requested)
+			fprintf(stderr, "%lu requests timed out, failed or were malformed, aborting\n", total);
+		stop_requested = 1;
+		return (ECANCELED);
+	}
+	return (0);
+}
+
+/*====================================================================================================================*
+ * cpu_begin()                                                                                                        *
+ *====================================================================================================================*/
+
+/**
+ * @brief CPU time spent on a run.
+ */
+struct cpu_stats {
+	uint64_t thread_ns; /**< CPU time of the threads issuing requests.      */
+	uint64_t user_ns;   /**< User CPU time of the whole process.             */
+	uint64_t sys_ns;    /**< System CPU time of the whole process.           */
+	uint64_t wall_ns;   /**< Wall-clock time of the run.                     */
+	uint64_t echoes;    /**< Requests whose echo came back during the run.   */
+};
+
+/**
+ * @brief Returns the CPU time consumed so far by the calling thread, in nanoseconds.
+ */
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	assert(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/**
+ * @brief Starts accounting for the CPU time of the whole process.
+ *
+ * Process time covers every thread, including those the libOS polls from.
+ * The counters hold the starting readings until cpu_end() turns them into
+ * time spent.
+ *
+ * @param cpu Target counters.
+ */
+static void cpu_begin(struct cpu_stats *cpu)
+{
+	struct rusage ru;
+
+	assert(getrusage(RUSAGE_SELF, &ru) == 0);
+	memset(cpu, 0, sizeof(struct cpu_stats));
+	cpu->user_ns = (uint64_t)ru.ru_utime.tv_sec * 1000000000 + ru.ru_utime.tv_usec * 1000;
+	cpu->sys_ns = (uint64_t)ru.ru_stime.tv_sec * 1000000000 + ru.ru_stime.tv_usec * 1000;
+	cpu->wall_ns = tsc_to_ns(read_tsc());
+}
+
+/**
+ * @brief Stops accounting for the CPU time of the whole process.
+ *
+ * @param cpu Counters set up with cpu_begin().
+ */
+static void cpu_end(struct cpu_stats *cpu)
+{
+	struct rusage ru;
+
+	assert(getrusage(RUSAGE_SELF, &ru) == 0);
+	cpu->user_ns = (uint64_t)ru.ru_utime.tv_sec * 1000000000 + ru.ru_utime.tv_usec * 1000 - cpu->user_ns;
+	cpu->sys_ns = (uint64_t)ru.ru_stime.tv_sec * 1000000000 + ru.ru_stime.tv_usec * 1000 - cpu->sys_ns;
+	cpu->wall_ns = tsc_to_ns(read_tsc()) - cpu->wall_ns;
+}
+
+/*====================================================================================================================*
+ * report_summary()                                                                                                   *
+ *====================================================================================================================*/
+
+/**
+ * @brief Prints the column names of the summary table. Latencies are in nanoseconds.
+ *
+ * @param first Name of the first column.
+ */
+static void report_header(const char *first)
+{
+	printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s\n", first, "msgs", "msgs/s", "p50", "p90", "p99", "p99.9",
+	       "p99.99", "max");
+}
+
+/**
+ * @brief Prints a summary row for a run.
+ *
+ * @param label   Name of the row.
+ * @param h       Latency histogram of the run.
+ * @param elapsed Duration of the run in TSC ticks.
+ */
+static void report_summary(const char *label, const struct hist *h, uint64_t elapsed)
+{
+	double rate = (elapsed > 0) ? (double)h->count * tsc_hz() / elapsed : 0;
+
+	if (h->count == 0)
+		return;
+	printf("%8s %10lu %10.0f %10lu %10lu %10lu %10lu %10lu %10lu\n", label, h->count, rate,
+	       tsc_to_ns(hist_percentile(h, 50)), tsc_to_ns(hist_percentile(h, 90)), tsc_to_ns(hist_percentile(h, 99)),
+	       tsc_to_ns(hist_percentile(h, 99.9)), tsc_to_ns(hist_percentile(h, 99.99)), tsc_to_ns(h->max));
+}
+
+/**
+ * @brief Prints a summary row corrected for coordinated omission, below the raw one.
+ *
+ * Corrected samples include requests that would have been sent during stalls,
+ * so there is no throughput for them.
+ *
+ * @param h Corrected latency histogram of the run.
+ */
+static void report_corrected(const struct hist *h)
+{
+	if (h->count == 0)
+		return;
+	printf("%8s %10lu %10s %10lu %10lu %10lu %10lu %10lu %10lu\n", "corr", h->count, "-",
+	       tsc_to_ns(hist_percentile(h, 50)), tsc_to_ns(hist_percentile(h, 90)), tsc_to_ns(hist_percentile(h, 99)),
+	       tsc_to_ns(hist_percentile(h, 99.9)), tsc_to_ns(hist_percentile(h, 99.99)), tsc_to_ns(h->max));
+}
+
+/**
+ * @brief Returns the interval at which each slot of a closed loop is expected to send requests.
+ *
+ * Every one of the outstanding requests of a pipelined connection is its own
+ * closed loop, so the interval is that of a slot, whatever the depth.
+ *
+ * @param cfg Run parameters.
+ * @param raw Latency histogram of the run.
+ *
+ * @return Expected interval in TSC ticks: cfg->co_interval if set, the median latency otherwise.
+ */
+static uint64_t co_interval(const struct client_config *cfg, const struct hist *raw)
+{
+	if (cfg->co_interval != 0)
+		return ((uint64_t)((double)cfg->co_interval * tsc_hz() / 1e9));
+	return (hist_percentile(raw, 50));
+}
+
+/**
+ * @brief Prints sequence anomalies detected in echoed headers, if any.
+ *
+ * @param seq Anomaly counters.
+ */
+static void report_seq(const struct seq_stats *seq)
+{
+	if (seq->lost == 0 && seq->reordered == 0 && seq->misrouted == 0)
+		return;
+	printf("sequence anomalies: %lu lost, %lu reordered, %lu misrouted\n", seq->lost, seq->reordered,
+	       seq->misrouted);
+}
+
+/**
+ * @brief Prints a summary row for each message size bucket, if messages are of several sizes.
+ *
+ * @param buckets Latency histograms of the buckets, NULL if messages are of a single size.
+ * @param used    Mask of the buckets in use.
+ * @param elapsed Duration of the run in TSC ticks.
+ */
+static void report_buckets(const struct hist *buckets, uint64_t used, uint64_t elapsed)
+{
+	char label[24];
+
+	if (buckets == NULL)
+		return;
+	report_header("bytes");
+	for (unsigned b = 0; b < SIZE_BUCKETS; b++)
+	{
+		if (!(used & (1ull << b)))
+			continue;
+		snprintf(label, sizeof(label), "<=%llu", 1ull << b);
+		report_summary(label, &buckets[b], elapsed);
+	}
+}
+
+/**
+ * @brief Prints requests given up on, if any.
+ *
+ * @param errors Error counters.
+ */
+static void report_errors(const struct error_stats *errors)
+{
+	if (errors->timeouts == 0 && errors->failed == 0 && errors->malformed == 0 && errors->reconnects == 0)
+		return;
+	printf("errors: %lu timed out, %lu failed, %lu malformed, %lu reconnects\n", errors->timeouts, errors->failed,
+	       errors->malformed, errors->reconnects);
+}
+
+/**
+ * @brief Prints whether the io_uring ring of each thread uses registered buffers, and records it in the summary.
+ *
+ * Registering them fails over RLIMIT_MEMLOCK, and pushes and pops then fall back to plain SEND and RECV, which
+ * costs a page pinning per request.
+ *
+ * @param cfg   Run parameters.
+ * @param fixed Whether the ring of each thread uses registered buffers.
+ * @param n     Number of threads.
+ */
+static void report_fixed_buffers(const struct client_config *cfg, const int *fixed, unsigned n)
+{
+	char *list = NULL;
+	unsigned nfixed = 0;
+
+	if (transport != &transport_uring)
+	{
+		if (cfg->summary != NULL)
+			summary_str(&cfg->summary->config, "fixed_buffers", NULL);
+		return;
+	}
+
+	list = calloc(2, n);
+	assert(list != NULL);
+	printf("fixed buffers:");
+	for (unsigned i = 0; i < n; i++)
+	{
+		printf("%s %s", (i > 0) ? "," : "", fixed[i] ? "yes" : "no");
+		list[2 * i] = fixed[i] ? '1' : '0';
+		list[2 * i + 1] = (i + 1 < n) ? ',' : '\0';
+		nfixed += (fixed[i] != 0);
+	}
+	printf("\n");
+	if (nfixed < n)
+		fprintf(stderr, "warning: %u of %u io_uring rings could not register their buffers, consider raising "
+			"RLIMIT_MEMLOCK\n", n - nfixed, n);
+	if (cfg->summary != NULL)
+		summary_str(&cfg->summary->config, "fixed_buffers", list);
+	free(list);
+}
+
+/**
+ * @brief Prints the CPU time spent per request, and how many cores the run kept busy.
+ *
+ * @param cpu CPU time of the run.
+ */
+static void report_cpu(const struct cpu_stats *cpu)
+{
+	if (cpu->echoes == 0 || cpu->wall_ns == 0)
+		return;
+	printf("cpu: %.2f us per request in client threads, %.2f us in the process (%.2f user, %.2f system), "
+	       "%.2f cores busy\n",
+	       cpu->thread_ns / 1e3 / cpu->echoes, (cpu->user_ns + cpu->sys_ns) / 1e3 / cpu->echoes,
+	       cpu->user_ns / 1e3 / cpu->echoes, cpu->sys_ns / 1e3 / cpu->echoes,
+	       (double)(cpu->user_ns + cpu->sys_ns) / cpu->wall_ns);
+}
+
+/*====================================================================================================================*
+ * summary_setup()                                                                                                    *
+ *====================================================================================================================*/
+
+/**
+ * @brief Records the run parameters and the clock calibration in the machine-readable summary.
+ *
+ * @param s          Target summary.
+ * @param cfg        Run parameters.
+ * @param addr       Server address, as given.
+ * @param port       Server port, as given.
+ * @param dist_spec  Message size distribution, as given, or NULL.
+ * @param trace_path Trace to replay, or NULL.
+ */
+static void summary_setup(struct summary *s, const struct client_config *cfg, const char *addr, const char *port,
+			  const char *dist_spec, const char *trace_path)
+{
+	static const char *const modes[] = {"closed", "open", "pipeline", "replay"};
+	static const char *const arrivals[] = {"const", "poisson"};
+	static const char *const framings[] = {"fixed", "prefix"};
+
+	summary_str(&s->config, "transport", transport->name);
+	summary_uint(&s->config, "sqpoll", uring_sqpoll);
+	summary_str(&s->config, "libos", getenv("LIBOS"));
+	summary_str(&s->config, "config_path", getenv("CONFIG_PATH"));
+	summary_str(&s->config, "server", addr);
+	summary_str(&s->config, "port", port);
+	summary_str(&s->config, "mode", modes[cfg->mode]);
+	summary_uint(&s->config, "min_size", cfg->min_size);
+	summary_uint(&s->config, "max_size", cfg->max_size);
+	summary_str(&s->config, "size_dist", dist_spec);
+	summary_str(&s->config, "trace", trace_path);
+	summary_real(&s->config, "speed", cfg->speed);
+	summary_uint(&s->config, "max_msgs", cfg->max_msgs);
+	summary_real(&s->config, "rate", cfg->rate);
+	summary_str(&s->config, "arrival", arrivals[cfg->arrival]);
+	summary_uint(&s->config, "inflight", cfg->inflight);
+	summary_uint(&s->config, "min_depth", cfg->min_depth);
+	summary_uint(&s->config, "max_depth", cfg->max_depth);
+	summary_uint(&s->config, "conns", cfg->conns);
+	summary_uint(&s->config, "threads", cfg->threads);
+	summary_uint(&s->config, "precision", cfg->precision);
+	summary_uint(&s->config, "pool_size", cfg->pool_size);
+	summary_str(&s->config, "framing", framings[cfg->framing]);
+	summary_uint(&s->config, "stamp", cfg->stamp);
+	summary_uint(&s->config, "timeout_ms", cfg->timeout_ms);
+	summary_uint(&s->config, "max_timeouts", cfg->max_timeouts);
+	summary_real(&s->config, "warmup_s", cfg->warmup);
+	summary_real(&s->config, "duration_s", cfg->duration);
+	summary_real(&s->config, "cooldown_s", cfg->cooldown);
+	summary_str(&s->config, "wait", wait_names[cfg->wait]);
+	summary_uint(&s->config, "spin_us", cfg->spin_us);
+	summary_uint(&s->config, "wait_batch", cfg->wait_batch);
+
+	summary_uint(&s->calibration, "tsc_hz", tsc_hz());
+	summary_uint(&s->calibration, "tsc_overhead_ticks", tsc_overhead());
+	summary_uint(&s->calibration, "tsc_invariant", tsc_invariant() != 0);
+}
+
+/**
+ * @brief Records the results of a run in the machine-readable summary, if there is one. Latencies are in nanoseconds.
+ *
+ * @param cfg       Run parameters.
+ * @param label     Name of the run in the report.
+ * @param size      Message size of the run.
+ * @param depth     Outstanding requests per connection.
+ * @param raw       Latency histogram of the run.
+ * @param corrected Latency histogram corrected for coordinated omission.
+ * @param pushes    Push completion histogram.
+ * @param elapsed   Duration of the run in TSC ticks.
+ * @param seq       Sequence anomalies.
+ * @param errors    Requests given up on.
+ * @param cpu       CPU time spent.
+ */
+static void summary_run(const struct client_config *cfg, const char *label, size_t size, unsigned depth,
+			const struct hist *raw, const struct hist *corrected, const struct hist *pushes,
+			uint64_t elapsed, const struct seq_stats *seq, const struct error_stats *errors,
+			const struct cpu_stats *cpu)
+{
+	struct summary_rec *r = NULL;
+
+	if (cfg->summary == NULL)
+		return;
+	r = summary_add_run(cfg->summary);
+	summary_str(r, "run", label);
+	summary_uint(r, "size", size);
+	summary_uint(r, "depth", depth);
+	summary_uint(r, "msgs", raw->count);
+	summary_real(r, "elapsed_s", (double)elapsed / tsc_hz());
+	summary_real(r, "msgs_per_s", (elapsed > 0) ? (double)raw->count * tsc_hz() / elapsed : 0);
+	summary_uint(r, "mean_ns", (raw->count > 0) ? tsc_to_ns(raw->sum / raw->count) : 0);
+	summary_uint(r, "p50_ns", tsc_to_ns(hist_percentile(raw, 50)));
+	summary_uint(r, "p90_ns", tsc_to_ns(hist_percentile(raw, 90)));
+	summary_uint(r, "p99_ns", tsc_to_ns(hist_percentile(raw, 99)));
+	summary_uint(r, "p99.9_ns", tsc_to_ns(hist_percentile(raw, 99.9)));
+	summary_uint(r, "p99.99_ns", tsc_to_ns(hist_percentile(raw, 99.99)));
+	summary_uint(r, "max_ns", tsc_to_ns(raw->max));
+	summary_uint(r, "corr_p50_ns", tsc_to_ns(hist_percentile(corrected, 50)));
+	summary_uint(r, "corr_p99_ns", tsc_to_ns(hist_percentile(corrected, 99)));
+	summary_uint(r, "corr_p99.9_ns", tsc_to_ns(hist_percentile(corrected, 99.9)));
+	summary_uint(r, "push_p50_ns", tsc_to_ns(hist_percentile(pushes, 50)));
+	summary_uint(r, "push_p99_ns", tsc_to_ns(hist_percentile(pushes, 99)));
+	summary_uint(r, "timeouts", errors->timeouts);
+	summary_uint(r, "failed", errors->failed);
+	summary_uint(r, "malformed", errors->malformed);
+	summary_uint(r, "reconnects", errors->reconnects);
+	summary_uint(r, "lost", seq->lost);
+	summary_uint(r, "reordered", seq->reordered);
+	summary_uint(r, "misrouted", seq->misrouted);
+	summary_real(r, "cpu_us_per_request", (cpu->echoes > 0) ? cpu->thread_ns / 1e3 / cpu->echoes : 0);
+	summary_real(r, "process_cpu_us_per_request",
+		     (cpu->echoes > 0) ? (cpu->user_ns + cpu->sys_ns) / 1e3 / cpu->echoes : 0);
+	summary_real(r, "user_us_per_request", (cpu->echoes > 0) ? cpu->user_ns / 1e3 / cpu->echoes : 0);
+	summary_real(r, "system_us_per_request", (cpu->echoes > 0) ? cpu->sys_ns / 1e3 / cpu->echoes : 0);
+	summary_real(r, "cores_busy", (cpu->wall_ns > 0) ? (double)(cpu->user_ns + cpu->sys_ns) / cpu->wall_ns : 0);
+}
+
+/**
+ * @brief Writes the machine-readable summary to the requested files.
+ *
+ * @param s         Target summary.
+ * @param json_path Path to the JSON summary, or NULL.
+ * @param csv_path  Path to the CSV summary, or NULL.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int summary_save(const struct summary *s, const char *json_path, const char *csv_path)
+{
+	const char *paths[] = {json_path, csv_path};
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		FILE *fp = NULL;
+
+		if (paths[i] == NULL)
+			continue;
+		if ((fp = fopen(paths[i], "w")) == NULL)
+		{
+			perror(paths[i]);
+			return (-1);
+		}
+		if (i == 0)
+			summary_write_json(s, fp);
+		else
+			summary_write_csv(s, fp);
+		if (fclose(fp) != 0)
+		{
+			perror(paths[i]);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+/*====================================================================================================================*
+ * payloads_init()                                                                                                    *
+ *====================================================================================================================*/
+
+/**
+ * @brief Messages to send: the distribution of their sizes and preallocated buffers of each size.
+ */
+struct payloads {
+	struct size_dist dist;  /**< Distribution of message sizes.                          */
+	struct sga_pool *pools; /**< Buffers of each size class.                             */
+	struct hist *buckets;   /**< Latency per power-of-two size bucket, NULL for one size. */
+	uint64_t used;          /**< Mask of the size buckets that can be drawn.             */
+	uint64_t misses;        /**< Buffers allocated on demand by previous pools.          */
+};
+
+/**
+ * @brief Preallocates buffers for every message size that can be drawn.
+ *
+ * The pool is split among size classes in proportion to how often each of
+ * them is drawn, to the nearest buffer. Latency is kept per size bucket when there are several sizes.
+ *
+ * @param pl  Target payloads.
+ * @param cfg Run parameters: cfg->dist, or cfg->data_size if there is none.
+ */
+static void payloads_init(struct payloads *pl, const struct client_config *cfg)
+{
+	memset(pl, 0, sizeof(struct payloads));
+	if (cfg->dist != NULL)
+		pl->dist = *cfg->dist;
+	else
+		size_dist_fixed(&pl->dist, cfg->data_size);
+
+	pl->pools = calloc(pl->dist.nclasses, sizeof(struct sga_pool));
+	assert(pl->pools != NULL);
+	for (unsigned i = 0; i < pl->dist.nclasses; i++)
+	{
+		/* Sizes too rare to expect half a buffer's worth are allocated on demand. */
+		unsigned size = (unsigned)(cfg->pool_size * pl->dist.probs[i] + 0.5);
+
+		assert(sga_pool_init(&pl->pools[i], size, pl->dist.sizes[i]) == 0);
+		pl->used |= 1ull << size_bucket(pl->dist.sizes[i]);
+	}
+
+	if (pl->dist.nclasses > 1)
+	{
+		pl->buckets = calloc(SIZE_BUCKETS, sizeof(struct hist));
+		assert(pl->buckets != NULL);
+		for (unsigned b = 0; b < SIZE_BUCKETS; b++)
+		{
+			if (pl->used & (1ull << b))
+				assert(hist_init(&pl->buckets[b], cfg->precision) == 0);
+		}
+	}
+}
+
+/**
+ * @brief Releases the buffers and histograms of a set of payloads.
+ */
+static void payloads_destroy(struct payloads *pl)
+{
+	for (unsigned i = 0; i < pl->dist.nclasses; i++)
+	{
+		pl->misses += pl->pools[i].misses;
+		sga_pool_destroy(&pl->pools[i]);
+	}
+	free(pl->pools);
+	pl->pools = NULL;
+	if (pl->buckets != NULL)
+	{
+		for (unsigned b = 0; b < SIZE_BUCKETS; b++)
+		{
+			if (pl->used & (1ull << b))
+				hist_destroy(&pl->buckets[b]);
+		}
+		free(pl->buckets);
+		pl->buckets = NULL;
+	}
+}
+
+/**
+ * @brief Draws the size of the next message and takes a buffer of that size.
+ *
+ * @param pl    Target payloads.
+ * @param class Storage location for the size class of the message.
+ *
+ * @return A filled scatter-gather array.
+ */
+static inline demi_sgarray_t payloads_get(struct payloads *pl, unsigned *class)
+{
+	*class = (pl->dist.nclasses > 1) ? size_dist_draw(&pl->dist, rng_uniform()) : 0;
+	return (sga_pool_get(&pl->pools[*class]));
+}
+
+/**
+ * @brief Takes a buffer of a given size class.
+ */
+static inline demi_sgarray_t payloads_take(struct payloads *pl, unsigned class)
+{
+	return (sga_pool_get(&pl->pools[class]));
+}
+
+/**
+ * @brief Gives a buffer taken with payloads_get() or payloads_take() back, restoring its full length.
+ */
+static inline void payloads_put(struct payloads *pl, unsigned class, demi_sgarray_t *sga)
+{
+	sga->sga_segs[0].sgaseg_len = pl->pools[class].data_size;
+	sga_pool_put(&pl->pools[class], sga);
+}
+
+/**
+ * @brief Records a latency sample in the bucket of the size of its message.
+ */
+static inline void payloads_record(struct payloads *pl, size_t size, uint64_t latency)
+{
+	if (pl->buckets != NULL)
+		hist_record(&pl->buckets[size_bucket(size)], latency);
+}
+
+/**
+ * @brief Clears the latency samples of every size bucket.
+ */
+static void payloads_reset(struct payloads *pl)
+{
+	for (unsigned b = 0; pl->buckets != NULL && b < SIZE_BUCKETS; b++)
+	{
+		if (pl->used & (1ull << b))
+			hist_reset(&pl->buckets[b]);
+	}
+}
+
+/**
+ * @brief Adds the latency samples of every size bucket of a set of payloads to another, drawn alike.
+ */
+static void payloads_merge(struct payloads *dst, const struct payloads *src)
+{
+	for (unsigned b = 0; dst->buckets != NULL && b < SIZE_BUCKETS; b++)
+	{
+		if (dst->used & (1ull << b))
+			hist_merge(&dst->buckets[b], &src->buckets[b]);
+	}
 }
 
 /*====================================================================================================================*
- * connect_wait()                                                                                                     *
+ * sweep_next()                                                                                                       *
  *====================================================================================================================*/
 
 /**
- * @brief Connects to a remote socket and waits for operation to complete.
+ * @brief Returns the message size that follows another one in a sweep.
+ *
+ * Sizes double, and the last step is cut short so that the sweep ends on the largest size, whatever the
+ * smallest one.
+ *
+ * @param size     Current size.
+ * @param max_size Largest size of the sweep.
  *
- * @param qd    Target queue descriptor.
- * @param saddr Remote socket address.
+ * @return The next size, above @p max_size once the sweep is over.
  */
-static void connect_wait(int qd, const struct sockaddr_in *saddr)
+static size_t sweep_next(size_t size, size_t max_size)
 {
-	demi_qtoken_t qt = -1;
-	demi_qresult_t qr = {0};
+	if (size >= max_size)
+		return (max_size + 1);
+	return ((size * 2 < max_size) ? size * 2 : max_size);
+}
 
-	/* Connect to remote */
-	assert(demi_connect(&qt, qd, (const struct sockaddr *)saddr, sizeof(struct sockaddr_in)) == 0);
+/*====================================================================================================================*
+ * client()                                                                                                           *
+ *====================================================================================================================*/
 
-	/* Wait for operation to complete. */
-	assert(demi_wait(&qr, qt, NULL) == 0);
+/**
+ * @brief TCP echo client.
+ *
+ * @param argc   Argument count.
+ * @param argv   Argument list.
+ * @param remote Remote socket address.
+ * @param cfg    Run parameters.
+ */
+static void client(int argc, char *const argv[], const struct sockaddr_in *remote, const struct client_config *cfg)
+{
+	int sockqd = -1;
+	struct hist measurments;
+	struct hist corrected;
+	struct hist pushes;
+	struct series series;
+	struct sample_log slog;
+	struct seq_stats seq = {0};
+	struct error_stats errors = {0};
+	struct cpu_stats cpu;
+	uint16_t tx_seq = 0;
+	uint16_t rx_seq = 0;
+	const uint64_t timeout = (uint64_t)cfg->timeout_ms * tsc_hz() / 1000;
+	const int sweep = (cfg->min_size != cfg->max_size);
+	char label[16];
+	int fixed = 0;
 
-	/* Parse operation result. */
-	assert(qr.qr_opcode == DEMI_OPC_CONNECT);
+	assert(hist_init(&measurments, cfg->precision) == 0);
+	assert(hist_init(&corrected, cfg->precision) == 0);
+	assert(hist_init(&pushes, cfg->precision) == 0);
+	series_setup(&series, cfg, 0);
+	sample_log_setup(&slog, cfg, 0);
+
+	/* Initialize the network stack. */
+	assert(transport->init(argc, argv) == 0);
+
+	/* Connect to server. */
+	assert(conn_open(&sockqd, remote, timeout) == 0);
+	fixed = (transport == &transport_uring) && uring_fixed_buffers();
+	report_fixed_buffers(cfg, &fixed, 1);
+
+	report_header(sweep ? "size" : "run");
+	for (size_t data_size = cfg->min_size; data_size <= cfg->max_size && sockqd >= 0 && !stop_requested;
+	     data_size = sweep_next(data_size, cfg->max_size))
+	{
+		size_t nbytes = 0;
+		unsigned nmsgs = 0;
+		struct client_config run = *cfg;
+		struct payloads pl;
+		struct rx_frame rx = {0};
+		uint64_t before, pushed, after, elapsed;
+		uint64_t thread_start = 0;
+		struct window win;
+
+		hist_reset(&measurments);
+		hist_reset(&pushes);
+		memset(&seq, 0, sizeof(struct seq_stats));
+		memset(&errors, 0, sizeof(struct error_stats));
+
+		/* Preallocate scatter-gather arrays. */
+		run.data_size = data_size;
+		payloads_init(&pl, &run);
+
+		/* Run. */
+		win = window_open(cfg, read_tsc());
+		series_start(&series, read_tsc());
+		cpu_begin(&cpu);
+		thread_start = thread_cpu_ns();
+		for (; nmsgs < cfg->max_msgs && !stop_requested; nmsgs++)
+		{
+			demi_qresult_t qr = {0};
+			demi_sgarray_t sga = {0};
+			unsigned class = 0;
+			size_t size = 0;
+			uint64_t deadline = 0;
+			int ret = 0;
+
+			/* Take cooked scatter-gather array. */
+			sga = payloads_get(&pl, &class);
+			assert(sga.sga_segs != 0);
+			size = pl.dist.sizes[class];
+
+			before = read_tsc();
+			if (!window_open_at(&win, before))
+			{
+				payloads_put(&pl, class, &sga);
+				break;
+			}
+			deadline = (timeout != 0) ? before + timeout : 0;
+			/* Stamp message. */
+			msg_write_hdr(sga.sga_segs[0].sgaseg_buf,
+				      &(struct msg_hdr){.len = size, .conn = 0, .seq = tx_seq++, .tsc = before});
+
+			/* Push scatter-gather array. */
+			rx_reset(&rx);
+			ret = push_wait(sockqd, &sga, &qr, deadline);
+			/* A failed push is over, so its scatter-gather array can be reused. */
+			if (ret == ECONNRESET)
+				payloads_put(&pl, class, &sga);
+			if (ret == 0)
+			{
+				pushed = read_tsc();
+
+				/* Recycle sent scatter-gather array. */
+				payloads_put(&pl, class, &sga);
+
+				/* Pop data scatter-gather arrays until the whole echo has arrived. */
+				while (!rx_done(&rx))
+				{
+					const demi_sgaseg_t *seg = &qr.qr_value.sga.sga_segs[0];
+
+					memset(&qr, 0, sizeof(demi_qresult_t));
+					if ((ret = pop_wait(sockqd, &qr, deadline)) != 0)
+						break;
+
+					/* Nothing else is in flight, so every byte belongs to this echo. */
+					if (rx_feed(&rx, seg->sgaseg_buf, seg->sgaseg_len, size, cfg->framing) !=
+					    (ssize_t)seg->sgaseg_len)
+						ret = EPROTO;
+					nbytes += seg->sgaseg_len;
+
+					/* Release received scatter-gather array. */
+					assert(transport->sgafree(&qr.qr_value.sga) == 0);
+					if (ret != 0)
+						break;
+				}
+			}
+
+			/*
+			 * The request was lost, is late enough to be treated as such, or its connection
+			 * failed or carried a malformed echo. What is still in flight on the connection
+			 * is unknown, so start over on a new one.
+			 */
+			if (ret == ETIMEDOUT || ret == ECONNRESET || ret == EPROTO)
+			{
+				assert(transport->close(sockqd) == 0);
+				if (count_errors(&errors, ret, 1, cfg->max_timeouts) != 0 ||
+				    conn_open(&sockqd, remote, timeout) != 0)
+				{
+					sockqd = -1;
+					break;
+				}
+				errors.reconnects++;
+				tx_seq = 0;
+				rx_seq = 0;
+				continue;
+			}
+			if (ret != 0)
+				break;
+			after = read_tsc();
+			cpu.echoes++;
+			if (cfg->stamp)
+			{
+				msg_check(&rx.hdr, 0, &rx_seq, &seq);
+
+				/* An echo that is not ours, or stamped in the future, has no send time worth sampling. */
+				if (rx.hdr.conn != 0 || rx.hdr.tsc > after)
+					continue;
+				before = rx.hdr.tsc;
+			}
+			if (window_has(&win, before))
+			{
+				hist_record(&pushes, pushed - before);
+				hist_record(&measurments, after - before);
+				payloads_record(&pl, size, after - before);
+				sample_log_add(&slog, before, after - before, size, 0);
+			}
+			series_record(&series, after, after - before);
+
+			/* fprintf(stdout, "pong (%zu)\n", nbytes); */
+		}
+		if (sweep)
+			snprintf(label, sizeof(label), "%zu", data_size);
+		else
+			snprintf(label, sizeof(label), "all");
+		elapsed = window_elapsed(&win, read_tsc());
+		cpu_end(&cpu);
+		cpu.thread_ns = thread_cpu_ns() - thread_start;
+		report_summary(label, &measurments, elapsed);
+		hist_correct(&corrected, &measurments, co_interval(cfg, &measurments));
+		report_corrected(&corrected);
+		report_summary("push", &pushes, elapsed);
+		report_buckets(pl.buckets, pl.used, elapsed);
+		report_seq(&seq);
+		report_errors(&errors);
+		report_cpu(&cpu);
+		summary_run(cfg, label, data_size, 1, &measurments, &corrected, &pushes, elapsed, &seq, &errors, &cpu);
+		if (cfg->interval_ms > 0)
+		{
+			series_print_header(stdout);
+			report_series(&series, read_tsc());
+		}
+
+		slog.run++;
+		payloads_destroy(&pl);
+		if (pl.misses > 0)
+			fprintf(stderr, "warning: buffer pool ran dry %lu times, consider a larger --pool\n", pl.misses);
+	}
+
+	/* Close socket. */
+	if (sockqd >= 0)
+		assert(transport->close(sockqd) == 0);
+
+	sample_log_finish(&slog);
+	series_destroy(&series);
+	hist_destroy(&pushes);
+	hist_destroy(&corrected);
+	hist_destroy(&measurments);
+
+	if (transport->fini != NULL)
+		transport->fini();
 }
 
 /*====================================================================================================================*
- * push_wait()                                                                                                        *
+ * run_async()                                                                                                        *
  *====================================================================================================================*/
 
 /**
- * @brief Pushes a scatter-gather array to a remote socket and waits for operation to complete.
+ * @brief A connection driven by the asynchronous engine.
+ */
+struct conn {
+	int qd;                /**< Socket I/O queue descriptor.                    */
+	demi_qtoken_t pop_qt;  /**< Pop that is kept posted on the socket.          */
+	uint64_t *sched;       /**< Send times of outstanding requests (ring).      */
+	uint64_t *issued;      /**< When they were actually sent (ring).            */
+	size_t *lens;          /**< Sizes of outstanding requests (ring).           */
+	unsigned head;         /**< Oldest outstanding request in the ring.         */
+	unsigned outstanding;  /**< Number of outstanding requests.                 */
+	struct rx_frame rx;    /**< Echo of the oldest request being received.      */
+	uint16_t id;           /**< Connection number stamped in messages.          */
+	uint16_t tx_seq;       /**< Sequence number of the next message sent.       */
+	uint16_t rx_seq;       /**< Sequence number of the next echo expected.      */
+	uint64_t count;        /**< Number of latency samples in this run.          */
+	uint64_t sum;          /**< Sum of latency samples in this run.             */
+	uint64_t min;          /**< Smallest latency sample in this run.            */
+	uint64_t max;          /**< Largest latency sample in this run.             */
+};
+
+/**
+ * @brief A thread running its own set of connections.
+ */
+struct worker {
+	pthread_t thread;            /**< Underlying thread.                                */
+	unsigned id;                 /**< Index of the worker.                              */
+	int core;                    /**< Core the worker is pinned to, -1 for none.        */
+	struct client_config cfg;    /**< Share of the run parameters for this worker.      */
+	const struct sockaddr_in *remote; /**< Remote socket address.                       */
+	struct conn *conns;          /**< Connections of this worker.                       */
+	struct payloads payloads;    /**< Message sizes and scatter-gather arrays to push.  */
+	size_t *replay;              /**< Requests of the trace sent by this worker.        */
+	struct hist measurments;     /**< Latency samples of the current run.               */
+	struct hist corrected;       /**< Samples from scheduled send times (open-loop).    */
+	struct hist pushes;          /**< Time from issuing pushes to their completion.     */
+	struct series series;        /**< Latency over time of the current run.             */
+	struct sample_log log;       /**< Every sample of every run, if logged.             */
+	struct seq_stats seq;        /**< Sequence anomalies of the current run.            */
+	struct error_stats errors;   /**< Requests given up on in the current run.          */
+	uint64_t elapsed;            /**< Duration of the current run.                      */
+	uint64_t end;                /**< When the current run ended.                       */
+	uint64_t cpu_ns;             /**< CPU time of the worker in the current run.        */
+	uint64_t echoes;             /**< Echoes received in the current run.               */
+	int fixed_bufs;              /**< Non-zero if the io_uring ring uses fixed buffers. */
+};
+
+/**
+ * @brief Operations pending in the asynchronous engine.
+ */
+struct op_table {
+	demi_qtoken_t *qts;   /**< Pending operations, as passed to transport->wait_any(). */
+	unsigned *owners;     /**< Connection each operation belongs to.             */
+	demi_sgarray_t *sgas; /**< Pushed data, empty for pops.                      */
+	unsigned *classes;    /**< Size class of pushed data.                        */
+	uint64_t *issued;     /**< When pushes were issued.                          */
+	unsigned n;           /**< Number of pending operations.                     */
+};
+
+/**
+ * @brief Removes an operation from a table, moving the last one in its place.
+ */
+static void ops_remove(struct op_table *ops, unsigned i)
+{
+	ops->n--;
+	ops->qts[i] = ops->qts[ops->n];
+	ops->owners[i] = ops->owners[ops->n];
+	ops->sgas[i] = ops->sgas[ops->n];
+	ops->classes[i] = ops->classes[ops->n];
+	ops->issued[i] = ops->issued[ops->n];
+}
+
+/**
+ * @brief Gives up on every request outstanding on a connection and opens a new one in its place.
+ *
+ * Pending operations of the connection are dropped and pushed data goes back
+ * to the pool. The connection is closed, since what it still carries is
+ * unknown, and reopened with a pop posted, unless the run is aborted.
  *
- * @param qd  Target queue descriptor.
- * @param sga Target scatter-gather array.
- * @param qr  Storage location for operation result.
+ * @param w       Target worker.
+ * @param i       Index of the connection.
+ * @param ops     Pending operations.
+ * @param timeout Ticks to wait for the new connection.
+ *
+ * @return Zero if the connection was reopened, non-zero if the run should stop.
  */
-static void push_wait(int qd, demi_sgarray_t *sga, demi_qresult_t *qr)
+static int conn_expire(struct worker *w, unsigned i, struct op_table *ops, uint64_t timeout)
 {
-	demi_qtoken_t qt = -1;
+	struct conn *c = &w->conns[i];
+	int ret = 0;
 
-	/* Push data. */
-	assert(demi_push(&qt, qd, sga) == 0);
+	for (unsigned j = 0; j < ops->n;)
+	{
+		if (ops->owners[j] != i)
+		{
+			j++;
+			continue;
+		}
+		if (ops->sgas[j].sga_numsegs != 0)
+			payloads_put(&w->payloads, ops->classes[j], &ops->sgas[j]);
+		ops_remove(ops, j);
+	}
+	assert(transport->close(c->qd) == 0);
 
-	/* Wait push operation to complete. */
-	assert(demi_wait(qr, qt, NULL) == 0);
+	c->head = 0;
+	c->outstanding = 0;
+	c->tx_seq = 0;
+	c->rx_seq = 0;
+	rx_reset(&c->rx);
 
-	/* Parse operation result. */
-	assert(qr->qr_opcode == DEMI_OPC_PUSH);
+	if ((ret = conn_open(&c->qd, w->remote, timeout)) != 0)
+	{
+		fprintf(stderr, "cannot reconnect connection %u, stopping\n", c->id);
+		c->qd = -1;
+		stop_requested = 1;
+		return (ret);
+	}
+	w->errors.reconnects++;
+
+	assert(transport->pop(&ops->qts[ops->n], c->qd) == 0);
+	ops->owners[ops->n] = i;
+	ops->sgas[ops->n++] = (demi_sgarray_t){0};
+	return (0);
 }
 
-/*====================================================================================================================*
- * pop_wait()                                                                                                         *
- *====================================================================================================================*/
+/**
+ * @brief Counts every request outstanding on a connection as given up on, and reopens the connection.
+ *
+ * The connection is left as is if the run is aborted.
+ *
+ * @param w       Target worker.
+ * @param i       Index of the connection.
+ * @param ops     Pending operations.
+ * @param err     Why the requests are given up on: ETIMEDOUT, ECONNRESET if the connection failed, or EPROTO
+ *                if it carried malformed echoes.
+ * @param timeout Ticks to wait for the new connection.
+ *
+ * @return Number of requests given up on.
+ */
+static unsigned conn_give_up(struct worker *w, unsigned i, struct op_table *ops, int err, uint64_t timeout)
+{
+	const unsigned n = w->conns[i].outstanding;
+
+	if (count_errors(&w->errors, err, n, w->cfg.max_timeouts) == 0)
+		conn_expire(w, i, ops, timeout);
+	return (n);
+}
 
 /**
- * @brief Pops a scatter-gather array and waits for operation to complete.
+ * @brief Drives requests over a set of connections with several of them outstanding.
+ *
+ * All pushes and pops of every connection are multiplexed in a single
+ * transport->wait_any() loop. In open-loop mode requests are sent on a schedule
+ * derived from the configured rate, round-robin over the connections.
+ * Latency is measured both from the actual send time, into w->measurments,
+ * and from the scheduled one, into w->corrected, which accounts for time a
+ * request spends waiting for a free slot. Otherwise a new request is sent as
+ * soon as one completes, keeping @p depth of them in flight on each connection.
+ * Echoes are matched to requests in order, since TCP preserves it. Replays
+ * work like open-loop mode, with the send times, connections, sizes and
+ * payloads of the requests of the trace assigned to the worker.
+ *
+ * When the oldest request of a connection has been outstanding for longer
+ * than cfg->timeout_ms, all of its requests are counted as timed out and the
+ * connection is reopened. The same goes for a connection on which an
+ * operation fails or that the server closes, whose requests are counted as
+ * failed.
+ *
+ * Only requests sent within the measurement window of the run are sampled.
+ * With a duration, requests are sent until the cooldown is over and the run
+ * ends once their echoes are in.
+ *
+ * Latency samples are added to w->measurments, timeouts and failures to w->errors, and the
+ * sampled duration of the run is stored in w->elapsed.
+ *
+ * @param w     Target worker, with a pop already posted on each connection.
+ * @param depth Maximum number of outstanding requests per connection.
  *
- * @param qd Target queue descriptor.
- * @param qr Storage location for operation result.
+ * @return Number of latency samples collected.
  */
-static void pop_wait(int qd, demi_qresult_t *qr)
+static unsigned run_async(struct worker *w, unsigned depth)
 {
-	demi_qtoken_t qt = -1;
+	const struct client_config *cfg = &w->cfg;
+	struct conn *conns = w->conns;
+	const unsigned nconns = cfg->conns;
+	const int replay = (cfg->mode == MODE_REPLAY);
+	const int open = (cfg->mode == MODE_OPEN || replay);
+	/* A push may still be pending once its echo is in, so leave room for one more push per request. */
+	const unsigned capacity = nconns * (2 * depth + 1);
+	unsigned sent = 0;
+	unsigned done = 0;
+	unsigned samples = 0;
+	unsigned rr = 0;
+	unsigned batch_left = 0;
+	const struct timespec poll = {0, 0};
+	const double interval = (open && !replay) ? (double)tsc_hz() / cfg->rate : 0;
+	const double ticks_per_ns = replay ? tsc_hz() / 1e9 / cfg->speed : 0;
+	const uint64_t timeout = (uint64_t)cfg->timeout_ms * tsc_hz() / 1000;
+	uint64_t start = 0;
+	uint64_t next_scan = 0;
+	struct window win;
+	double next = 0;
+	struct op_table ops = {
+		.qts = calloc(capacity, sizeof(demi_qtoken_t)),
+		.owners = calloc(capacity, sizeof(unsigned)),
+		.sgas = calloc(capacity, sizeof(demi_sgarray_t)),
+		.classes = calloc(capacity, sizeof(unsigned)),
+		.issued = calloc(capacity, sizeof(uint64_t)),
+		.n = 0,
+	};
 
-	/* Pop data. */
-	assert(demi_pop(&qt, qd) == 0);
+	assert(ops.qts != NULL && ops.owners != NULL && ops.sgas != NULL && ops.classes != NULL &&
+	       ops.issued != NULL);
 
-	/* Wait for pop operation to complete. */
-	assert(demi_wait(qr, qt, NULL) == 0);
+	for (unsigned i = 0; i < nconns; i++)
+	{
+		struct conn *c = &conns[i];
 
-	/* Parse operation result. */
-	assert(qr->qr_opcode == DEMI_OPC_POP);
-	assert(qr->qr_value.sga.sga_segs != 0);
+		c->sched = calloc(depth, sizeof(uint64_t));
+		c->issued = calloc(depth, sizeof(uint64_t));
+		c->lens = calloc(depth, sizeof(size_t));
+		assert(c->sched != NULL && c->issued != NULL && c->lens != NULL);
+		c->head = 0;
+		c->outstanding = 0;
+		rx_reset(&c->rx);
+		c->count = 0;
+		c->sum = 0;
+		c->min = UINT64_MAX;
+		c->max = 0;
+
+		ops.qts[ops.n] = c->pop_qt;
+		ops.owners[ops.n++] = i;
+	}
+	memset(&w->seq, 0, sizeof(struct seq_stats));
+	memset(&w->errors, 0, sizeof(struct error_stats));
+
+	start = read_tsc();
+	win = window_open(cfg, start);
+	series_start(&w->series, start);
+	w->cpu_ns = thread_cpu_ns();
+	w->echoes = 0;
+	next = (double)start;
+	if (replay && cfg->max_msgs > 0)
+		next += cfg->trace->recs[w->replay[0]].offset * ticks_per_ns;
+	next_scan = start + timeout / TIMEOUT_SCANS;
+	for (;;)
+	{
+		demi_qresult_t qr = {0};
+		struct conn *c = NULL;
+		int offset = -1;
+		int ret = 0;
+		uint64_t now = read_tsc();
+		/* Once the last request is out, only wait for the ones still outstanding. */
+		const int sending = (sent < cfg->max_msgs && window_open_at(&win, now));
+
+		if (stop_requested || (!sending && done == sent))
+			break;
+
+		/* Give up on connections whose oldest request is overdue, between batches. */
+		if (batch_left == 0 && timeout != 0 && now >= next_scan)
+		{
+			for (unsigned i = 0; i < nconns && !stop_requested; i++)
+			{
+				c = &conns[i];
+				if (c->outstanding == 0 || now < c->issued[c->head] + timeout)
+					continue;
+				done += conn_give_up(w, i, &ops, ETIMEDOUT, timeout);
+			}
+			next_scan = now + timeout / TIMEOUT_SCANS;
+			continue;
+		}
+
+		/* Issue every request whose send time has come, between batches. */
+		for (unsigned tries = 0;
+		     batch_left == 0 && sending && sent < cfg->max_msgs && tries < nconns && ops.n < capacity &&
+		     (!open || (uint64_t)next <= now);)
+		{
+			demi_sgarray_t sga = {0};
+			const struct trace_rec *rec = replay ? &cfg->trace->recs[w->replay[sent]] : NULL;
+			unsigned class = 0;
+			size_t size = 0;
+			uint64_t sched = 0;
+
+			if (replay)
+				rr = rec->conn % nconns;
+			c = &conns[rr];
+			if (c->outstanding == depth)
+			{
+				/* In open-loop mode, requests go out in order, so wait for this connection. */
+				if (open)
+					break;
+				rr = (rr + 1) % nconns;
+				tries++;
+				continue;
+			}
+
+			if (replay)
+			{
+				/* Send the captured size and payload, in a buffer of the next size up. */
+				class = rec->class;
+				sga = payloads_take(&w->payloads, class);
+				assert(sga.sga_segs != 0);
+				size = rec->size;
+				sga.sga_segs[0].sgaseg_len = size;
+				memcpy((uint8_t *)sga.sga_segs[0].sgaseg_buf + sizeof(struct msg_hdr),
+				       cfg->trace->payloads + rec->payload, rec->payload_len);
+			}
+			else
+			{
+				sga = payloads_get(&w->payloads, &class);
+				assert(sga.sga_segs != 0);
+				size = w->payloads.dist.sizes[class];
+			}
+
+			c->issued[(c->head + c->outstanding) % depth] = read_tsc();
+			sched = open ? (uint64_t)next : c->issued[(c->head + c->outstanding) % depth];
+			c->sched[(c->head + c->outstanding) % depth] = sched;
+			c->lens[(c->head + c->outstanding) % depth] = size;
+			msg_write_hdr(sga.sga_segs[0].sgaseg_buf,
+				      &(struct msg_hdr){.len = size, .conn = c->id, .seq = c->tx_seq++, .tsc = sched});
+			assert(transport->push(&ops.qts[ops.n], c->qd, &sga) == 0);
+			ops.owners[ops.n] = rr;
+			ops.classes[ops.n] = class;
+			ops.issued[ops.n] = c->issued[(c->head + c->outstanding) % depth];
+			ops.sgas[ops.n++] = sga;
+
+			c->outstanding++;
+			sent++;
+			tries = 0;
+			if (replay && sent < cfg->max_msgs)
+				next = start + cfg->trace->recs[w->replay[sent]].offset * ticks_per_ns;
+			else if (open)
+			{
+				next += next_interarrival(cfg->arrival, interval);
+				rr = (rr + 1) % nconns;
+			}
+		}
+
+		/* Within a batch, only take what has already completed. */
+		if (batch_left > 0)
+		{
+			ret = transport->wait_any(&qr, &offset, ops.qts, ops.n, &poll);
+			if (ret == ETIMEDOUT)
+			{
+				batch_left = 0;
+				continue;
+			}
+			assert(ret == 0);
+			batch_left--;
+		}
+		else
+		{
+			uint64_t deadline = (timeout != 0) ? next_scan : 0;
+
+			/*
+			 * Wake up in time for the next expiry check, or for the next send on schedule unless it
+			 * is already due and held back by a full connection, which only a completion frees.
+			 */
+			if (open && sending && (uint64_t)next > now && (deadline == 0 || (uint64_t)next < deadline))
+				deadline = (uint64_t)next;
+			ret = wait_any_until(&qr, &offset, ops.qts, ops.n, deadline);
+			if (ret == ETIMEDOUT)
+				continue;
+			if (ret != 0)
+				break;
+			if (cfg->wait == WAIT_BATCH)
+				batch_left = cfg->wait_batch - 1;
+		}
+		now = read_tsc();
+		c = &conns[ops.owners[offset]];
+
+		switch (qr.qr_opcode)
+		{
+		case DEMI_OPC_PUSH:
+			if (window_has(&win, ops.issued[offset]))
+				hist_record(&w->pushes, now - ops.issued[offset]);
+
+			/* Recycle sent scatter-gather array. */
+			payloads_put(&w->payloads, ops.classes[offset], &ops.sgas[offset]);
+			ops_remove(&ops, offset);
+			break;
+
+		case DEMI_OPC_POP:
+		{
+			const demi_sgaseg_t *seg = &qr.qr_value.sga.sga_segs[0];
+			size_t off = 0;
+			int malformed = 0;
+
+			/* An empty pop means that the server closed the connection. */
+			if (seg->sgaseg_len == 0)
+			{
+				assert(transport->sgafree(&qr.qr_value.sga) == 0);
+				done += conn_give_up(w, ops.owners[offset], &ops, ECONNRESET, timeout);
+				break;
+			}
+
+			/* Every complete echo finishes the oldest outstanding request. */
+			while (off < seg->sgaseg_len)
+			{
+				uint64_t sched = c->sched[c->head];
+				uint64_t latency = 0;
+				int sampled = 1;
+				ssize_t used = 0;
+
+				/* Bytes that no request asked for, or a bad length, leave the stream out of step. */
+				if (c->outstanding == 0 ||
+				    (used = rx_feed(&c->rx, (const uint8_t *)seg->sgaseg_buf + off, seg->sgaseg_len - off,
+						    c->lens[c->head], cfg->framing)) < 0)
+				{
+					malformed = 1;
+					break;
+				}
+				off += used;
+				if (!rx_done(&c->rx))
+					break;
+
+				if (cfg->stamp)
+				{
+					int16_t ahead = (int16_t)(c->rx.hdr.seq - c->rx_seq);
+
+					/* Requests the server skipped are lost: stop waiting for them. */
+					if (c->rx.hdr.conn == c->id && ahead > 0 && (unsigned)ahead < c->outstanding)
+					{
+						c->head = (c->head + ahead) % depth;
+						c->outstanding -= ahead;
+						done += ahead;
+					}
+					msg_check(&c->rx.hdr, c->id, &c->rx_seq, &w->seq);
+
+					/* An echo that is not ours, or stamped in the future, has no send time worth sampling. */
+					if (c->rx.hdr.conn == c->id && c->rx.hdr.tsc <= now)
+						sched = c->rx.hdr.tsc;
+					else
+						sampled = 0;
+				}
+				/* Raw latency is from the actual send time, the scheduled one gives the corrected latency. */
+				latency = now - (open ? c->issued[c->head] : sched);
+				rx_reset(&c->rx);
+				done++;
+				w->echoes++;
+				if (sampled && window_has(&win, sched))
+				{
+					hist_record(&w->measurments, latency);
+					if (open)
+						hist_record(&w->corrected, now - sched);
+					payloads_record(&w->payloads, c->lens[c->head], latency);
+					samples++;
+					c->count++;
+					c->sum += latency;
+					c->min = (latency < c->min) ? latency : c->min;
+					c->max = (latency > c->max) ? latency : c->max;
+					sample_log_add(&w->log, now - latency, latency, c->lens[c->head], c->id);
+				}
+				if (sampled)
+					series_record(&w->series, now, latency);
+
+				c->head = (c->head + 1) % depth;
+				c->outstanding--;
+			}
+
+			/* Release received scatter-gather array and post the next pop. */
+			assert(transport->sgafree(&qr.qr_value.sga) == 0);
+			if (malformed)
+				done += conn_give_up(w, ops.owners[offset], &ops, EPROTO, timeout);
+			else
+				assert(transport->pop(&ops.qts[offset], c->qd) == 0);
+			break;
+		}
+
+		case DEMI_OPC_FAILED:
+			/* The connection was reset, or pushing to it failed: its state is unknown. */
+			done += conn_give_up(w, ops.owners[offset], &ops, ECONNRESET, timeout);
+			break;
+
+		default:
+			assert(0 && "unexpected operation");
+		}
+	}
+	w->end = read_tsc();
+	w->cpu_ns = thread_cpu_ns() - w->cpu_ns;
+	w->elapsed = window_elapsed(&win, w->end);
+	w->log.run++;
+
+	/*
+	 * Wait for pushes that are still in flight, so that the next run starts clean. A stopped run has no next
+	 * one, and echoes may still be on their way, so it leaves everything as is rather than take their pops.
+	 */
+	while (ops.n > nconns && !stop_requested)
+	{
+		demi_qresult_t qr = {0};
+		int offset = -1;
+
+		if (wait_any_until(&qr, &offset, ops.qts, ops.n, deadline_after(timeout)) != 0)
+			break;
+
+		/* A push may complete after its echo arrived, which ended the run: it still counts. */
+		if (qr.qr_opcode == DEMI_OPC_PUSH && window_has(&win, ops.issued[offset]))
+			hist_record(&w->pushes, read_tsc() - ops.issued[offset]);
+		if (qr.qr_opcode == DEMI_OPC_PUSH ||
+		    (qr.qr_opcode == DEMI_OPC_FAILED && ops.sgas[offset].sga_numsegs != 0))
+		{
+			payloads_put(&w->payloads, ops.classes[offset], &ops.sgas[offset]);
+			ops_remove(&ops, offset);
+			continue;
+		}
+
+		/* No more echoes are due: the pop failed, or the server closed the connection or sent extra data. */
+		if (qr.qr_opcode == DEMI_OPC_POP)
+			assert(transport->sgafree(&qr.qr_value.sga) == 0);
+		if (conn_expire(w, ops.owners[offset], &ops, timeout) != 0)
+			break;
+	}
+
+	/* Only pops are left, unless the run was stopped halfway or pushes got stuck. */
+	if (ops.n > nconns && !stop_requested)
+	{
+		fprintf(stderr, "pushes still pending after the run, stopping\n");
+		stop_requested = 1;
+	}
+	for (unsigned i = 0; i < ops.n && !stop_requested; i++)
+		conns[ops.owners[i]].pop_qt = ops.qts[i];
+	for (unsigned i = 0; i < nconns; i++)
+	{
+		free(conns[i].sched);
+		free(conns[i].lens);
+		free(conns[i].issued);
+		conns[i].sched = NULL;
+		conns[i].issued = NULL;
+		conns[i].lens = NULL;
+	}
+
+	free(ops.issued);
+	free(ops.classes);
+	free(ops.sgas);
+	free(ops.owners);
+	free(ops.qts);
+	return (samples);
 }
 
+/*====================================================================================================================*
+ * report_conns()                                                                                                     *
+ *====================================================================================================================*/
 
-static void report_measurements(uint64_t *m, size_t count)
+/**
+ * @brief Prints a summary for each connection, if there are several of them. Latencies are in nanoseconds.
+ *
+ * @param conns  Connections.
+ * @param nconns Number of connections.
+ * @param first  Number of the first connection in the report.
+ */
+static void report_conns(const struct conn *conns, unsigned nconns, unsigned first)
 {
-	printf("-------------------------------------\n");
-	for (size_t i = 0; i < count; i++) {
-		printf("%ld\n", m[i]);
+	if (nconns < 2)
+		return;
+	printf("%8s %10s %12s %12s %12s\n", "conn", "msgs", "mean", "min", "max");
+	for (unsigned i = 0; i < nconns; i++)
+	{
+		const struct conn *c = &conns[i];
+
+		if (c->count == 0)
+			printf("%8u %10d %12s %12s %12s\n", first + i, 0, "-", "-", "-");
+		else
+			printf("%8u %10lu %12lu %12lu %12lu\n", first + i, c->count, tsc_to_ns(c->sum / c->count),
+			       tsc_to_ns(c->min), tsc_to_ns(c->max));
 	}
-	printf("-------------------------------------\n");
 }
 
 /*====================================================================================================================*
- * client()                                                                                                           *
+ * client_async()                                                                                                     *
  *====================================================================================================================*/
 
+/* Synchronize workers at the start and at the end of each run. */
+static pthread_barrier_t run_start;
+static pthread_barrier_t run_stop;
+
+/* Depth of the next run, zero when workers should exit. */
+static unsigned run_depth = 0;
+
+/* Message size of the next run. */
+static size_t run_size = 0;
+
 /**
- * @brief TCP echo client.
+ * @brief Returns the first and last depth of the runs to make.
+ */
+static void depth_range(const struct client_config *cfg, unsigned *first, unsigned *last)
+{
+	if (cfg->mode == MODE_PIPELINE)
+	{
+		*first = cfg->min_depth;
+		*last = cfg->max_depth;
+	}
+	else
+	{
+		*first = (cfg->mode == MODE_OPEN || cfg->mode == MODE_REPLAY) ? cfg->inflight : 1;
+		*last = *first;
+	}
+}
+
+/**
+ * @brief Pins the calling thread to a core.
+ */
+static void pin_to_core(int core)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	assert(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0);
+}
+
+/**
+ * @brief Opens the connections of a worker.
+ *
+ * @param w Target worker.
+ */
+static void worker_connect(struct worker *w)
+{
+	w->conns = calloc(w->cfg.conns, sizeof(struct conn));
+	assert(w->conns != NULL);
+	assert(hist_init(&w->measurments, w->cfg.precision) == 0);
+	assert(hist_init(&w->corrected, w->cfg.precision) == 0);
+	assert(hist_init(&w->pushes, w->cfg.precision) == 0);
+	series_setup(&w->series, &w->cfg, w->id);
+	sample_log_setup(&w->log, &w->cfg, w->id);
+	payloads_init(&w->payloads, &w->cfg);
+
+	for (unsigned i = 0; i < w->cfg.conns; i++)
+	{
+		w->conns[i].id = w->id * w->cfg.conns + i;
+
+		/* Connect to server. */
+		assert(conn_open(&w->conns[i].qd, w->remote, (uint64_t)w->cfg.timeout_ms * tsc_hz() / 1000) == 0);
+
+		/* Keep one pop posted at all times. */
+		assert(transport->pop(&w->conns[i].pop_qt, w->conns[i].qd) == 0);
+	}
+
+	/* Opening a connection set up the ring of the thread, if any. */
+	w->fixed_bufs = (transport == &transport_uring) && uring_fixed_buffers();
+}
+
+/**
+ * @brief Switches a worker to another message size, refilling its pool with buffers of that size.
+ *
+ * @param w         Target worker.
+ * @param data_size Number of bytes in each message of the next run.
+ */
+static void worker_resize(struct worker *w, size_t data_size)
+{
+	uint64_t misses = 0;
+
+	if (w->cfg.data_size == data_size)
+		return;
+	payloads_destroy(&w->payloads);
+	misses = w->payloads.misses;
+	w->cfg.data_size = data_size;
+	payloads_init(&w->payloads, &w->cfg);
+	w->payloads.misses = misses;
+}
+
+/**
+ * @brief Closes the connections of a worker.
+ *
+ * @param w Target worker.
+ */
+static void worker_close(struct worker *w)
+{
+	for (unsigned i = 0; i < w->cfg.conns; i++)
+	{
+		if (w->conns[i].qd >= 0)
+			assert(transport->close(w->conns[i].qd) == 0);
+	}
+}
+
+/**
+ * @brief Body of a worker thread.
+ *
+ * @param arg Target worker.
+ */
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+
+	if (w->core >= 0)
+		pin_to_core(w->core);
+	rng_state ^= read_tsc() + w->id;
+
+	worker_connect(w);
+	pthread_barrier_wait(&run_stop);
+
+	for (;;)
+	{
+		pthread_barrier_wait(&run_start);
+		if (run_depth == 0)
+			break;
+		worker_resize(w, run_size);
+		hist_reset(&w->measurments);
+		hist_reset(&w->corrected);
+		hist_reset(&w->pushes);
+		payloads_reset(&w->payloads);
+		run_async(w, run_depth);
+		pthread_barrier_wait(&run_stop);
+	}
+
+	worker_close(w);
+	return (NULL);
+}
+
+/**
+ * @brief TCP echo client with several requests outstanding.
+ *
+ * Runs cfg->threads workers, each on its own cfg->conns connections, and
+ * splits the messages and the offered load evenly among them. With a single
+ * worker everything runs on the calling thread. In open-loop mode, or in
+ * closed-loop mode over several connections, a single run is made. In
+ * pipelined mode one run is made for each depth, doubling from cfg->min_depth
+ * up to cfg->max_depth over the same connections. All of this is repeated for
+ * each message size, doubling from cfg->min_size to cfg->max_size. A latency summary is
+ * reported for each run, with per-worker and per-connection summaries when
+ * there are several of them.
  *
  * @param argc   Argument count.
  * @param argv   Argument list.
  * @param remote Remote socket address.
- * @param data_size Number of bytes in each message.
- * @param max_msgs Maximum number of messages to transfer.
+ * @param cfg    Run parameters.
  */
-static void client(int argc, char *const argv[], const struct sockaddr_in *remote, size_t data_size, unsigned max_msgs)
+static void client_async(int argc, char *const argv[], const struct sockaddr_in *remote,
+			 const struct client_config *cfg)
 {
-	size_t nbytes = 0;
-	int sockqd = -1;
-	size_t max_bytes = data_size * max_msgs;
-	uint64_t *measurments = calloc(MAX_MSGS + 100, sizeof(uint64_t));
-	size_t m_index = 0;
-	time_t before, after;
+	const unsigned nworkers = cfg->threads;
+	struct worker *workers = calloc(nworkers, sizeof(struct worker));
+	struct hist measurments;
+	struct hist corrected;
+	struct hist pushes;
+	struct payloads merged;
+	struct client_config merged_cfg = *cfg;
+	unsigned first, last;
+	const int sweep = (cfg->min_size != cfg->max_size);
+	char label[16];
+	int *fixed = NULL;
 
-	/* Initialize demikernel */
-	assert(demi_init(argc, argv) == 0);
+	assert(workers != NULL);
+	assert(hist_init(&measurments, cfg->precision) == 0);
+	assert(hist_init(&corrected, cfg->precision) == 0);
+	assert(hist_init(&pushes, cfg->precision) == 0);
 
-	/* Setup socket. */
-	assert(demi_socket(&sockqd, AF_INET, SOCK_STREAM, 0) == 0);
+	/* Size buckets of all workers, without buffers of their own. */
+	merged_cfg.pool_size = 0;
+	payloads_init(&merged, &merged_cfg);
 
-	/* Connect to server. */
-	connect_wait(sockqd, remote);
+	/* Initialize the network stack. */
+	assert(transport->init(argc, argv) == 0);
 
-	/* Run. */
-	while (nbytes < max_bytes)
+	for (unsigned i = 0; i < nworkers; i++)
 	{
-		demi_qresult_t qr = {0};
-		demi_sgarray_t sga = {0};
+		struct worker *w = &workers[i];
 
-		/* Allocate scatter-gather array. */
-		sga = demi_sgaalloc(data_size);
-		assert(sga.sga_segs != 0);
+		w->id = i;
+		w->core = (cfg->ncores > 0) ? cfg->cores[i % cfg->ncores] : -1;
+		w->remote = remote;
+		w->cfg = *cfg;
+		w->cfg.max_msgs = cfg->max_msgs / nworkers + (i < cfg->max_msgs % nworkers);
+		w->cfg.rate = cfg->rate / nworkers;
+		if (cfg->trace != NULL)
+		{
+			/* Connection c of the trace is replayed on connection c modulo the number of them. */
+			w->replay = calloc(cfg->trace->n, sizeof(size_t));
+			assert(w->replay != NULL);
+			w->cfg.max_msgs = 0;
+			for (size_t j = 0; j < cfg->trace->n; j++)
+			{
+				if ((cfg->trace->recs[j].conn % (nworkers * cfg->conns)) / cfg->conns == i)
+					w->replay[w->cfg.max_msgs++] = j;
+			}
+		}
+	}
+
+	/* Spawn workers. */
+	if (nworkers == 1)
+	{
+		if (workers[0].core >= 0)
+			pin_to_core(workers[0].core);
+		worker_connect(&workers[0]);
+	}
+	else
+	{
+		assert(pthread_barrier_init(&run_start, NULL, nworkers + 1) == 0);
+		assert(pthread_barrier_init(&run_stop, NULL, nworkers + 1) == 0);
+		for (unsigned i = 0; i < nworkers; i++)
+			assert(pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) == 0);
+
+		/* Wait for every worker to connect. */
+		pthread_barrier_wait(&run_stop);
+	}
+	fixed = calloc(nworkers, sizeof(int));
+	assert(fixed != NULL);
+	for (unsigned i = 0; i < nworkers; i++)
+		fixed[i] = workers[i].fixed_bufs;
+	report_fixed_buffers(cfg, fixed, nworkers);
+	free(fixed);
 
-		/* Cook data. */
-		memset(sga.sga_segs[0].sgaseg_buf, 0xAB, data_size);
+	/* Run. */
+	depth_range(cfg, &first, &last);
+	for (size_t size = cfg->min_size; size <= cfg->max_size && !stop_requested;
+	     size = sweep_next(size, cfg->max_size))
+	{
+		if (sweep && cfg->mode == MODE_PIPELINE)
+			printf("size %zu\n", size);
+		for (unsigned depth = first; depth <= last && !stop_requested; depth *= 2)
+		{
+			struct seq_stats seq = {0};
+			struct error_stats errors = {0};
+			struct cpu_stats cpu;
+			uint64_t elapsed = 0;
 
-		before = read_tsc();
-		/* Push scatter-gather array. */
-		push_wait(sockqd, &sga, &qr);
+			cpu_begin(&cpu);
+			if (nworkers == 1)
+			{
+				struct worker *w = &workers[0];
 
-		/* Release sent scatter-gather array. */
-		assert(demi_sgafree(&sga) == 0);
+				worker_resize(w, size);
+				hist_reset(&w->measurments);
+				hist_reset(&w->corrected);
+				hist_reset(&w->pushes);
+				payloads_reset(&w->payloads);
+				run_async(w, depth);
+			}
+			else
+			{
+				run_depth = depth;
+				run_size = size;
+				pthread_barrier_wait(&run_start);
+				pthread_barrier_wait(&run_stop);
+			}
+			cpu_end(&cpu);
 
-		/* Pop data scatter-gather array. */
-		memset(&qr, 0, sizeof(demi_qresult_t));
-		pop_wait(sockqd, &qr);
-		after = read_tsc();
-		measurments[m_index] = after - before;
-		m_index++;
+			/* Merge samples of all workers. */
+			hist_reset(&measurments);
+			hist_reset(&pushes);
+			payloads_reset(&merged);
+			for (unsigned i = 0; i < nworkers; i++)
+			{
+				hist_merge(&measurments, &workers[i].measurments);
+				hist_merge(&pushes, &workers[i].pushes);
+				payloads_merge(&merged, &workers[i].payloads);
+				elapsed = (workers[i].elapsed > elapsed) ? workers[i].elapsed : elapsed;
+			}
 
-		nbytes += qr.qr_value.sga.sga_segs[0].sgaseg_len;
+			report_header((cfg->mode == MODE_PIPELINE) ? "depth" : (sweep ? "size" : "run"));
+			if (nworkers > 1)
+			{
+				for (unsigned i = 0; i < nworkers; i++)
+				{
+					snprintf(label, sizeof(label), "t%u", i);
+					report_summary(label, &workers[i].measurments, workers[i].elapsed);
+				}
+			}
+			if (cfg->mode == MODE_PIPELINE)
+				snprintf(label, sizeof(label), "%u", depth);
+			else if (sweep)
+				snprintf(label, sizeof(label), "%zu", size);
+			else
+				snprintf(label, sizeof(label), "all");
+			report_summary(label, &measurments, elapsed);
+			if (cfg->mode == MODE_OPEN || cfg->mode == MODE_REPLAY)
+			{
+				hist_reset(&corrected);
+				for (unsigned i = 0; i < nworkers; i++)
+					hist_merge(&corrected, &workers[i].corrected);
+			}
+			else
+				hist_correct(&corrected, &measurments, co_interval(cfg, &measurments));
+			report_corrected(&corrected);
+			report_summary("push", &pushes, elapsed);
+			report_buckets(merged.buckets, merged.used, elapsed);
+			for (unsigned i = 0; i < nworkers; i++)
+			{
+				seq.lost += workers[i].seq.lost;
+				seq.reordered += workers[i].seq.reordered;
+				seq.misrouted += workers[i].seq.misrouted;
+				errors.timeouts += workers[i].errors.timeouts;
+				errors.failed += workers[i].errors.failed;
+				errors.malformed += workers[i].errors.malformed;
+				errors.reconnects += workers[i].errors.reconnects;
+				cpu.thread_ns += workers[i].cpu_ns;
+				cpu.echoes += workers[i].echoes;
+			}
+			report_seq(&seq);
+			report_errors(&errors);
+			report_cpu(&cpu);
+			summary_run(cfg, label, size, depth, &measurments, &corrected, &pushes, elapsed, &seq, &errors,
+				    &cpu);
+			for (unsigned i = 0; i < nworkers; i++)
+				report_conns(workers[i].conns, workers[i].cfg.conns, i * cfg->conns);
+			if (cfg->interval_ms > 0)
+				series_print_header(stdout);
+			for (unsigned i = 0; i < nworkers; i++)
+				report_series(&workers[i].series, workers[i].end);
+		}
+	}
 
-		/* Release received scatter-gather array. */
-		assert(demi_sgafree(&qr.qr_value.sga) == 0);
+	/* Tear down workers. */
+	if (nworkers == 1)
+		worker_close(&workers[0]);
+	else
+	{
+		run_depth = 0;
+		pthread_barrier_wait(&run_start);
+		for (unsigned i = 0; i < nworkers; i++)
+			assert(pthread_join(workers[i].thread, NULL) == 0);
+		pthread_barrier_destroy(&run_start);
+		pthread_barrier_destroy(&run_stop);
+	}
 
-		/* fprintf(stdout, "pong (%zu)\n", nbytes); */
+	for (unsigned i = 0; i < nworkers; i++)
+	{
+		payloads_destroy(&workers[i].payloads);
+		if (workers[i].payloads.misses > 0)
+			fprintf(stderr, "warning: buffer pool of thread %u ran dry %lu times, consider a larger --pool\n", i,
+				workers[i].payloads.misses);
+		hist_destroy(&workers[i].measurments);
+		hist_destroy(&workers[i].corrected);
+		hist_destroy(&workers[i].pushes);
+		series_destroy(&workers[i].series);
+		sample_log_finish(&workers[i].log);
+		free(workers[i].conns);
+		free(workers[i].replay);
 	}
-	report_measurements(measurments, m_index);
+	payloads_destroy(&merged);
+	hist_destroy(&pushes);
+	hist_destroy(&corrected);
+	hist_destroy(&measurments);
+	free(workers);
+
+	/* Every buffer is back and every worker is gone. */
+	if (transport->fini != NULL)
+		transport->fini();
 }
 
 /*====================================================================================================================*
@@ -194,7 +2274,58 @@ static void client(int argc, char *const argv[], const struct sockaddr_in *remot
  */
 static void usage(const char *progname)
 {
-	fprintf(stderr, "Usage: %s ipv4-address port\n", progname);
+	fprintf(stderr, "Usage: %s [options] ipv4-address port [data-size [max-msgs]]\n", progname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --transport=demikernel|kernel|io_uring\n");
+	fprintf(stderr, "                            Network stack to measure (default: demikernel).\n");
+	fprintf(stderr, "  --sqpoll                  Have a kernel thread poll io_uring submissions.\n");
+	fprintf(stderr, "  --wait=block|spin|hybrid|batch\n");
+	fprintf(stderr, "                            How to wait for completions (default: block).\n");
+	fprintf(stderr, "  --spin=US                 Microseconds to poll before blocking with --wait=hybrid\n");
+	fprintf(stderr, "                            (default: %d).\n", SPIN_US);
+	fprintf(stderr, "  --batch=N                 Completions taken per wake-up with --wait=batch (default: %d).\n",
+		BATCH);
+	fprintf(stderr, "  --mode=closed|open|pipeline|replay\n");
+	fprintf(stderr, "                            How requests are issued (default: closed).\n");
+	fprintf(stderr, "  --rate=N                  Requests per second in open-loop mode.\n");
+	fprintf(stderr, "  --trace=PATH              JSONL trace of requests to replay in replay mode.\n");
+	fprintf(stderr, "  --speed=X                 Replay X times as fast as captured (default: 1).\n");
+	fprintf(stderr, "  --arrival=const|poisson   Inter-arrival times in open-loop mode (default: const).\n");
+	fprintf(stderr, "  --inflight=N              Maximum outstanding requests per connection in open-loop and\n");
+	fprintf(stderr, "                            replay modes (default: %d).\n",
+			INFLIGHT);
+	fprintf(stderr, "  --conns=N                 Number of connections per thread (default: 1).\n");
+	fprintf(stderr, "  --threads=N               Number of worker threads, not with demikernel (default: 1).\n");
+	fprintf(stderr, "  --co-interval=NS          Expected send interval for coordinated-omission correction in\n");
+	fprintf(stderr, "                            closed and pipelined modes (default: median latency).\n");
+	fprintf(stderr, "  --precision=N             Significant digits of latency histograms, 1 to 5 (default: %d).\n",
+			PRECISION);
+	fprintf(stderr, "  --pool=N                  Preallocated buffers per thread, 0 to allocate each message\n");
+	fprintf(stderr, "                            (default: %d).\n", POOL_SIZE);
+	fprintf(stderr, "  --framing=fixed|prefix    Delimit echoes by request size or by a length in the header\n");
+	fprintf(stderr, "                            (default: fixed).\n");
+	fprintf(stderr, "  --no-stamp                Ignore echoed headers, for servers that overwrite them.\n");
+	fprintf(stderr, "  --timeout=MS              Time to wait for an echo before giving up on a request and\n");
+	fprintf(stderr, "                            reconnecting, 0 to wait forever (default: %d).\n", TIMEOUT);
+	fprintf(stderr, "  --max-timeouts=N          Abort the run after N timed out or failed requests, 0 never to\n");
+	fprintf(stderr, "                            abort (default: 0).\n");
+	fprintf(stderr, "  --duration=S              Sample for S seconds instead of max-msgs messages (default: 0).\n");
+	fprintf(stderr, "  --warmup=S                Seconds of load before sampling starts (default: 0).\n");
+	fprintf(stderr, "  --cooldown=S              Seconds of load after sampling ends, with --duration (default: 0).\n");
+	fprintf(stderr, "  --interval=MS             Print latency over time in windows of MS milliseconds\n");
+	fprintf(stderr, "                            (default: 0, none).\n");
+	fprintf(stderr, "  --live                    Print each window to stderr as it closes, with --interval.\n");
+	fprintf(stderr, "  --samples=PATH            Log every sample to a binary file, PATH.N for thread N with\n");
+	fprintf(stderr, "                            several threads, for the analyze tool.\n");
+	fprintf(stderr, "  --json=PATH               Also write a machine-readable summary as JSON.\n");
+	fprintf(stderr, "  --csv=PATH                Also write a machine-readable summary as CSV, one row per run.\n");
+	fprintf(stderr, "  --cores=LIST              Cores to pin worker threads to, e.g. 0,2,4-7 (default: none).\n");
+	fprintf(stderr, "  --sizes=N-M               Sweep message sizes, doubling from N to M bytes, over the same\n");
+	fprintf(stderr, "                            connections (default: data-size only).\n");
+	fprintf(stderr, "  --size-dist=DIST          Draw message sizes from uniform:MIN-MAX, bimodal:SMALL,LARGE,P,\n");
+	fprintf(stderr, "                            pareto:MIN,ALPHA[,MAX] or file:PATH (an empirical CDF).\n");
+	fprintf(stderr, "  --depth=N[-M]             Outstanding requests in pipelined mode, doubling from N to M\n");
+	fprintf(stderr, "                            (default: %d-%d).\n", MIN_DEPTH, MAX_DEPTH);
 }
 
 /*====================================================================================================================*
@@ -218,36 +2349,383 @@ void build_sockaddr(const char *const ip_str, const char *const port_str, struct
 	assert(inet_pton(AF_INET, ip_str, &addr->sin_addr) == 1);
 }
 
+/*====================================================================================================================*
+ * parse_cores()                                                                                                      *
+ *====================================================================================================================*/
+
+/**
+ * @brief Parses a list of cores, such as 0,2,4-7.
+ *
+ * @param str    String representation of the list.
+ * @param cores  Storage location for the cores.
+ * @param ncores Storage location for the number of cores.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int parse_cores(const char *str, int *cores, unsigned *ncores)
+{
+	*ncores = 0;
+	while (*str != '\0')
+	{
+		int lo = -1, hi = -1, n = 0;
+
+		if (sscanf(str, "%d-%d%n", &lo, &hi, &n) != 2)
+		{
+			if (sscanf(str, "%d%n", &lo, &n) != 1)
+				return (-1);
+			hi = lo;
+		}
+		if (lo < 0 || hi < lo)
+			return (-1);
+		for (int core = lo; core <= hi; core++)
+		{
+			if (*ncores == MAX_CORES)
+				return (-1);
+			cores[(*ncores)++] = core;
+		}
+		str += n;
+		if (*str == ',')
+			str++;
+		else if (*str != '\0')
+			return (-1);
+	}
+	return ((*ncores > 0) ? 0 : -1);
+}
+
 /*====================================================================================================================*
  * main()                                                                                                             *
  *====================================================================================================================*/
 
+static const struct option long_options[] = {
+	{"mode", required_argument, NULL, 'm'},
+	{"rate", required_argument, NULL, 'r'},
+	{"arrival", required_argument, NULL, 'a'},
+	{"inflight", required_argument, NULL, 'i'},
+	{"depth", required_argument, NULL, 'd'},
+	{"conns", required_argument, NULL, 'c'},
+	{"threads", required_argument, NULL, 't'},
+	{"cores", required_argument, NULL, 'C'},
+	{"precision", required_argument, NULL, 'p'},
+	{"pool", required_argument, NULL, 'P'},
+	{"framing", required_argument, NULL, 'f'},
+	{"no-stamp", no_argument, NULL, 'S'},
+	{"timeout", required_argument, NULL, 'T'},
+	{"max-timeouts", required_argument, NULL, 'x'},
+	{"warmup", required_argument, NULL, 'w'},
+	{"duration", required_argument, NULL, 'D'},
+	{"cooldown", required_argument, NULL, 'o'},
+	{"sizes", required_argument, NULL, 's'},
+	{"size-dist", required_argument, NULL, 'z'},
+	{"trace", required_argument, NULL, 'R'},
+	{"speed", required_argument, NULL, 'X'},
+	{"co-interval", required_argument, NULL, 'I'},
+	{"interval", required_argument, NULL, 'n'},
+	{"live", no_argument, NULL, 'l'},
+	{"samples", required_argument, NULL, 'g'},
+	{"json", required_argument, NULL, 'j'},
+	{"csv", required_argument, NULL, 'v'},
+	{"transport", required_argument, NULL, 'k'},
+	{"sqpoll", no_argument, NULL, 'Q'},
+	{"wait", required_argument, NULL, 'W'},
+	{"spin", required_argument, NULL, 'U'},
+	{"batch", required_argument, NULL, 'B'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0},
+};
+
 int main(int argc, char *const argv[])
 {
-	if (argc >= 3)
+	struct client_config cfg = {
+		.data_size = DATA_SIZE,
+		.min_size = 0,
+		.max_size = 0,
+		.dist = NULL,
+		.trace = NULL,
+		.speed = 1,
+		.co_interval = 0,
+		.max_msgs = MAX_MSGS,
+		.mode = MODE_CLOSED,
+		.rate = 0,
+		.arrival = ARRIVAL_CONST,
+		.inflight = INFLIGHT,
+		.min_depth = MIN_DEPTH,
+		.max_depth = MAX_DEPTH,
+		.conns = 1,
+		.threads = 1,
+		.ncores = 0,
+		.precision = PRECISION,
+		.pool_size = POOL_SIZE,
+		.framing = FRAMING_FIXED,
+		.stamp = 1,
+		.timeout_ms = TIMEOUT,
+		.max_timeouts = 0,
+		.warmup = 0,
+		.duration = 0,
+		.cooldown = 0,
+		.interval_ms = 0,
+		.live = 0,
+		.sample_path = NULL,
+		.summary = NULL,
+		.wait = WAIT_BLOCK,
+		.spin_us = SPIN_US,
+		.wait_batch = BATCH,
+	};
+	struct size_dist dist;
+	const char *dist_spec = NULL;
+	struct trace trace;
+	const char *trace_path = NULL;
+	struct summary summary;
+	const char *json_path = NULL;
+	const char *csv_path = NULL;
+	int opt = -1;
+
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'm':
+			if (strcmp(optarg, "closed") == 0)
+				cfg.mode = MODE_CLOSED;
+			else if (strcmp(optarg, "open") == 0)
+				cfg.mode = MODE_OPEN;
+			else if (strcmp(optarg, "pipeline") == 0)
+				cfg.mode = MODE_PIPELINE;
+			else if (strcmp(optarg, "replay") == 0)
+				cfg.mode = MODE_REPLAY;
+			else
+				goto bad_usage;
+			break;
+		case 'r':
+			sscanf(optarg, "%lf", &cfg.rate);
+			break;
+		case 'a':
+			if (strcmp(optarg, "const") == 0)
+				cfg.arrival = ARRIVAL_CONST;
+			else if (strcmp(optarg, "poisson") == 0)
+				cfg.arrival = ARRIVAL_POISSON;
+			else
+				goto bad_usage;
+			break;
+		case 'i':
+			sscanf(optarg, "%u", &cfg.inflight);
+			break;
+		case 'd':
+			if (sscanf(optarg, "%u-%u", &cfg.min_depth, &cfg.max_depth) == 1)
+				cfg.max_depth = cfg.min_depth;
+			break;
+		case 'c':
+			sscanf(optarg, "%u", &cfg.conns);
+			break;
+		case 't':
+			sscanf(optarg, "%u", &cfg.threads);
+			break;
+		case 'C':
+			if (parse_cores(optarg, cfg.cores, &cfg.ncores) != 0)
+				goto bad_usage;
+			break;
+		case 'p':
+			sscanf(optarg, "%u", &cfg.precision);
+			if (cfg.precision < 1 || cfg.precision > 5)
+				goto bad_usage;
+			break;
+		case 'P':
+			sscanf(optarg, "%u", &cfg.pool_size);
+			break;
+		case 'f':
+			if (strcmp(optarg, "fixed") == 0)
+				cfg.framing = FRAMING_FIXED;
+			else if (strcmp(optarg, "prefix") == 0)
+				cfg.framing = FRAMING_PREFIX;
+			else
+				goto bad_usage;
+			break;
+		case 'S':
+			cfg.stamp = 0;
+			break;
+		case 'T':
+			sscanf(optarg, "%u", &cfg.timeout_ms);
+			break;
+		case 'x':
+			sscanf(optarg, "%u", &cfg.max_timeouts);
+			break;
+		case 'w':
+			sscanf(optarg, "%lf", &cfg.warmup);
+			break;
+		case 'D':
+			sscanf(optarg, "%lf", &cfg.duration);
+			break;
+		case 'o':
+			sscanf(optarg, "%lf", &cfg.cooldown);
+			break;
+		case 's':
+			if (sscanf(optarg, "%zu-%zu", &cfg.min_size, &cfg.max_size) != 2)
+				goto bad_usage;
+			break;
+		case 'z':
+			dist_spec = optarg;
+			break;
+		case 'R':
+			trace_path = optarg;
+			break;
+		case 'X':
+			sscanf(optarg, "%lf", &cfg.speed);
+			break;
+		case 'I':
+			sscanf(optarg, "%u", &cfg.co_interval);
+			break;
+		case 'n':
+			sscanf(optarg, "%u", &cfg.interval_ms);
+			break;
+		case 'l':
+			cfg.live = 1;
+			break;
+		case 'g':
+			cfg.sample_path = optarg;
+			break;
+		case 'j':
+			json_path = optarg;
+			break;
+		case 'v':
+			csv_path = optarg;
+			break;
+		case 'k':
+			if ((transport = transport_find(optarg)) == NULL)
+				goto bad_usage;
+			break;
+		case 'Q':
+			uring_sqpoll = 1;
+			break;
+		case 'W':
+			for (cfg.wait = WAIT_BLOCK; cfg.wait <= WAIT_BATCH; cfg.wait++)
+			{
+				if (strcmp(optarg, wait_names[cfg.wait]) == 0)
+					break;
+			}
+			if (cfg.wait > WAIT_BATCH)
+				goto bad_usage;
+			break;
+		case 'U':
+			sscanf(optarg, "%u", &cfg.spin_us);
+			break;
+		case 'B':
+			sscanf(optarg, "%u", &cfg.wait_batch);
+			break;
+		default:
+			goto bad_usage;
+		}
+	}
+
+	if (argc - optind >= 2)
 	{
 		reg_sighandlers();
 
 		struct sockaddr_in saddr = {0};
-		size_t data_size = DATA_SIZE;
-		unsigned max_msgs = MAX_MSGS;
 
-		if (argc >= 4)
-			sscanf(argv[3], "%zu", &data_size);
-		if (argc >= 5)
-			sscanf(argv[4], "%u", &max_msgs);
+		if (argc - optind >= 3)
+			sscanf(argv[optind + 2], "%zu", &cfg.data_size);
+		if (argc - optind >= 4)
+			sscanf(argv[optind + 3], "%u", &cfg.max_msgs);
+		else if (cfg.duration > 0)
+			cfg.max_msgs = UINT32_MAX;
+
+		/* Without a sweep, every run uses data-size. */
+		if (cfg.min_size == 0)
+		{
+			cfg.min_size = cfg.data_size;
+			cfg.max_size = cfg.data_size;
+		}
+		cfg.data_size = cfg.min_size;
 
 		/* The server that I work with require this space */
-		assert (data_size > 16);
+		assert (cfg.data_size > 16);
+		assert(cfg.min_size <= cfg.max_size);
+
+		/* Draw message sizes from a distribution, instead of sweeping them. */
+		if (dist_spec != NULL)
+		{
+			assert(cfg.min_size == cfg.max_size);
+			if (size_dist_parse(&dist, dist_spec, sizeof(struct msg_hdr) + 1) != 0)
+			{
+				fprintf(stderr, "invalid size distribution: %s\n", dist_spec);
+				return (EXIT_FAILURE);
+			}
+			cfg.dist = &dist;
+		}
+
+		/* Parse the trace ahead of the run. */
+		if (cfg.mode == MODE_REPLAY)
+		{
+			assert(trace_path != NULL && cfg.speed > 0 && cfg.min_size == cfg.max_size && cfg.dist == NULL);
+			if (trace_load(&trace, trace_path, sizeof(struct msg_hdr) + 1) != 0)
+			{
+				fprintf(stderr, "invalid trace: %s\n", trace_path);
+				return (EXIT_FAILURE);
+			}
+			cfg.trace = &trace;
+			cfg.dist = &trace.dist;
+		}
+		assert(cfg.conns > 0 && cfg.threads > 0 && cfg.threads <= cfg.max_msgs);
+
+		/* Libdemikernel runs a single libOS that fails concurrent calls with EBUSY, so workers cannot share it. */
+		if (cfg.threads > 1 && transport == &transport_demikernel)
+		{
+			fprintf(stderr, "--threads=%u needs another transport than demikernel\n", cfg.threads);
+			return (EXIT_FAILURE);
+		}
+
 		/* Build addresses.*/
-		build_sockaddr(argv[1], argv[2], &saddr);
+		build_sockaddr(argv[optind], argv[optind + 1], &saddr);
+
+		/* Calibrate clock. */
+		tsc_calibrate();
+		assert(cfg.wait_batch > 0);
+		wait_strategy = cfg.wait;
+		wait_spin = (uint64_t)cfg.spin_us * tsc_hz() / 1000000;
+
+		/* Every thread logs send times from the same instant, so that their logs line up. */
+		cfg.log_origin = read_tsc();
+
+		/* Keep results for dashboards, along with what produced them. */
+		summary_init(&summary);
+		if (json_path != NULL || csv_path != NULL)
+		{
+			summary_setup(&summary, &cfg, argv[optind], argv[optind + 1], dist_spec, trace_path);
+			cfg.summary = &summary;
+		}
 
 		/* Run. */
-		client(argc, argv, &saddr, data_size, max_msgs);
+		printf("transport: %s%s\n", transport->name,
+		       (transport == &transport_uring && uring_sqpoll) ? " (sqpoll)" : "");
+		printf("wait: %s\n", wait_names[cfg.wait]);
+		if (cfg.mode == MODE_OPEN)
+		{
+			assert(cfg.rate > 0 && cfg.inflight > 0);
+			rng_state ^= read_tsc();
+			client_async(argc, argv, &saddr, &cfg);
+		}
+		else if (cfg.mode == MODE_REPLAY)
+		{
+			assert(cfg.inflight > 0);
+			client_async(argc, argv, &saddr, &cfg);
+			trace_destroy(&trace);
+		}
+		else if (cfg.mode == MODE_PIPELINE)
+		{
+			assert(cfg.min_depth > 0 && cfg.min_depth <= cfg.max_depth);
+			client_async(argc, argv, &saddr, &cfg);
+		}
+		else if (cfg.conns > 1 || cfg.threads > 1)
+			client_async(argc, argv, &saddr, &cfg);
+		else
+			client(argc, argv, &saddr, &cfg);
 
+		if (summary_save(&summary, json_path, csv_path) != 0)
+			return (EXIT_FAILURE);
+		summary_destroy(&summary);
 		return (EXIT_SUCCESS);
 	}
 
+bad_usage:
 	usage(argv[0]);
 
 	return (EXIT_SUCCESS);
@@ -3,24 +3,50 @@
 
 #include "common.h"
 
+/**
+ * @brief Non-zero once a termination signal has been received, or a thread asked the run to stop.
+ */
+atomic_int stop_requested = 0;
+
 /**
  * @brief Signal handler.
  *
+ * Asks the run to stop, so that it can report what it has measured so far. The
+ * handler is registered for one shot, so a second signal terminates the
+ * program right away.
+ *
+ * The program keeps printing after the signal, so the handler only makes
+ * async-signal-safe calls: no stdio, and no strsignal().
+ *
  * @param signum Number of received signal.
  */
 void sighandler(int signum)
 {
     #ifdef __linux__
-    const char *signame = strsignal(signum);
-    fprintf(stderr, "\nReceived %s signal\n", signame);
+    const char *msg = "\nReceived signal\nStopping...\n";
+
+    switch (signum)
+    {
+    case SIGINT:
+        msg = "\nReceived Interrupt signal\nStopping...\n";
+        break;
+    case SIGQUIT:
+        msg = "\nReceived Quit signal\nStopping...\n";
+        break;
+    case SIGTSTP:
+        msg = "\nReceived Stopped signal\nStopping...\n";
+        break;
+    }
+    /* Nothing can be done if stderr is gone. */
+    ssize_t ret = write(STDERR_FILENO, msg, strlen(msg));
+    (void)ret;
     #endif
 
     #ifdef _WIN32
-    fprintf(stderr, "\nReceived %d signal\n", signum);
+    (void)signum;
     #endif
 
-    fprintf(stderr, "Exiting...\n");
-    exit(EXIT_SUCCESS);
+    stop_requested = 1;
 }
 
 /**
@@ -28,10 +54,20 @@ void sighandler(int signum)
  */
 void reg_sighandlers()
 {
-    signal(SIGINT, sighandler);
-
     #ifdef __linux__
-    signal(SIGQUIT, sighandler);
-    signal(SIGTSTP, sighandler);
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sighandler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    sigaction(SIGTSTP, &sa, NULL);
+    #endif
+
+    #ifdef _WIN32
+    signal(SIGINT, sighandler);
     #endif
 }
@@ -8,13 +8,20 @@
 #define COMMON_H_IS_INCLUDED
 
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #ifdef __linux__
 #include <string.h>
+#include <unistd.h>
 #endif
 
+/**
+ * @brief Non-zero once a termination signal has been received, or a thread asked the run to stop.
+ */
+extern atomic_int stop_requested;
+
 /**
  * @brief Signal handler.
  *
@@ -0,0 +1,213 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hist.h"
+
+/**
+ * @brief Initializes a histogram.
+ *
+ * Keeping d significant digits takes 2 * 10^d sub-buckets, rounded up to a
+ * power of two, in each bucket.
+ *
+ * @param h      Target histogram.
+ * @param digits Number of significant decimal digits to keep, from 1 to 5.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int hist_init(struct hist *h, unsigned digits)
+{
+	uint64_t sub_buckets = 2;
+
+	if (digits < 1 || digits > 5)
+		return (-1);
+	for (unsigned i = 0; i < digits; i++)
+		sub_buckets *= 10;
+
+	h->sub_bits = 1;
+	while ((1ull << h->sub_bits) < sub_buckets)
+		h->sub_bits++;
+
+	/* The largest index belongs to values with the top bit set. */
+	h->ncounts = hist_index(h, UINT64_MAX) + 1;
+	h->counts = calloc(h->ncounts, sizeof(uint64_t));
+	if (h->counts == NULL)
+		return (-1);
+	hist_reset(h);
+	return (0);
+}
+
+/**
+ * @brief Releases the memory of a histogram.
+ *
+ * @param h Target histogram.
+ */
+void hist_destroy(struct hist *h)
+{
+	free(h->counts);
+	h->counts = NULL;
+}
+
+/**
+ * @brief Forgets every value recorded in a histogram.
+ *
+ * @param h Target histogram.
+ */
+void hist_reset(struct hist *h)
+{
+	memset(h->counts, 0, h->ncounts * sizeof(uint64_t));
+	h->count = 0;
+	h->sum = 0;
+	h->min = UINT64_MAX;
+	h->max = 0;
+}
+
+/**
+ * @brief Adds the values recorded in a histogram to another one with the same precision.
+ *
+ * @param dst Target histogram.
+ * @param src Source histogram.
+ */
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+	for (size_t i = 0; i < dst->ncounts; i++)
+		dst->counts[i] += src->counts[i];
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/**
+ * @brief Returns the largest value that falls into a counter.
+ */
+static uint64_t hist_highest(const struct hist *h, size_t index)
+{
+	const size_t half = (size_t)1 << (h->sub_bits - 1);
+	unsigned shift;
+
+	if (index < 2 * half)
+		return (index);
+	shift = index / half - 1;
+	return (((uint64_t)(index - shift * half + 1) << shift) - 1);
+}
+
+/**
+ * @brief Returns the smallest value that falls into a counter.
+ */
+static uint64_t hist_lowest(const struct hist *h, size_t index)
+{
+	const size_t half = (size_t)1 << (h->sub_bits - 1);
+	unsigned shift;
+
+	if (index < 2 * half)
+		return (index);
+	shift = index / half - 1;
+	return ((uint64_t)(index - shift * half) << shift);
+}
+
+/**
+ * @brief Returns the value in the middle of a counter, which stands for the values that fall into it.
+ */
+static uint64_t hist_median(const struct hist *h, size_t index)
+{
+	const uint64_t low = hist_lowest(h, index);
+
+	return (low + (hist_highest(h, index) - low + 1) / 2);
+}
+
+/**
+ * @brief Fills a histogram with the values of another one, corrected for coordinated omission.
+ *
+ * A value larger than the expected interval between requests means that
+ * requests that should have been sent meanwhile were held back. For each of
+ * them, a value is added as if it had been sent on time and had waited: v -
+ * interval, v - 2 * interval, and so on down to the interval. Each counter
+ * stands for its values by the one in its middle, capped at the largest
+ * value recorded.
+ *
+ * The values that fall into the same counter are added at once, so the work
+ * is bounded by the number of counters, however small the interval and large
+ * the stalls.
+ *
+ * @param dst      Target histogram, with the same precision as @p src.
+ * @param src      Source histogram.
+ * @param interval Expected interval between requests, zero for no correction.
+ */
+void hist_correct(struct hist *dst, const struct hist *src, uint64_t interval)
+{
+	hist_reset(dst);
+	hist_merge(dst, src);
+	if (interval == 0)
+		return;
+
+	for (size_t i = 0; i < src->ncounts; i++)
+	{
+		uint64_t n = src->counts[i];
+		uint64_t v = hist_median(src, i);
+
+		if (n == 0)
+			continue;
+		v = (v < src->max) ? v : src->max;
+		if (v / 2 < interval)
+			continue;
+
+		/* Walk the values down from v - interval, a counter at a time. */
+		for (uint64_t missing = v - interval;;)
+		{
+			const size_t j = hist_index(dst, missing);
+			const uint64_t low = hist_lowest(dst, j);
+			/* Number of values in this counter, from missing down to low or the interval. */
+			const uint64_t k = (missing - ((low > interval) ? low : interval)) / interval + 1;
+			const uint64_t last = missing - (k - 1) * interval;
+
+			dst->counts[j] += n * k;
+			dst->count += n * k;
+			dst->sum += n * (k * missing - interval * (k * (k - 1) / 2));
+			if (last < dst->min)
+				dst->min = last;
+			if (last - interval < interval)
+				break;
+			missing = last - interval;
+		}
+	}
+}
+
+/**
+ * @brief Returns the value at a percentile.
+ *
+ * @param h Target histogram.
+ * @param p Percentile, from 0 to 100.
+ *
+ * @return Largest value equivalent to the value at percentile @p p, capped at the largest recorded value.
+ */
+uint64_t hist_percentile(const struct hist *h, double p)
+{
+	uint64_t rank = 0;
+	uint64_t seen = 0;
+
+	if (h->count == 0)
+		return (0);
+
+	rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > h->count)
+		rank = h->count;
+
+	for (size_t i = 0; i < h->ncounts; i++)
+	{
+		seen += h->counts[i];
+		if (seen >= rank)
+		{
+			uint64_t v = hist_highest(h, i);
+
+			return ((v < h->max) ? v : h->max);
+		}
+	}
+	return (h->max);
+}
@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef HIST_H_IS_INCLUDED
+#define HIST_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief High-dynamic-range histogram.
+ *
+ * Values are grouped in buckets that cover a power-of-two range each, and
+ * every bucket is split in a fixed number of linear sub-buckets. The relative
+ * error of any recorded value is thus bounded by the number of sub-buckets,
+ * while memory does not depend on how many values are recorded.
+ */
+struct hist {
+	unsigned sub_bits;  /**< Log2 of the number of sub-buckets per bucket. */
+	size_t ncounts;     /**< Number of counters.                           */
+	uint64_t *counts;   /**< Counters.                                     */
+	uint64_t count;     /**< Number of recorded values.                    */
+	uint64_t sum;       /**< Sum of recorded values.                       */
+	uint64_t min;       /**< Smallest recorded value.                      */
+	uint64_t max;       /**< Largest recorded value.                       */
+};
+
+/**
+ * @brief Returns the counter that a value falls into.
+ */
+static inline size_t hist_index(const struct hist *h, uint64_t v)
+{
+	unsigned shift;
+
+	if (v < (1ull << h->sub_bits))
+		return ((size_t)v);
+	shift = (63 - __builtin_clzll(v)) - (h->sub_bits - 1);
+	return (((size_t)shift << (h->sub_bits - 1)) + (size_t)(v >> shift));
+}
+
+/**
+ * @brief Records a value.
+ *
+ * @param h Target histogram.
+ * @param v Value to record.
+ */
+static inline void hist_record(struct hist *h, uint64_t v)
+{
+	h->counts[hist_index(h, v)]++;
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+}
+
+/**
+ * @brief Initializes a histogram.
+ *
+ * @param h      Target histogram.
+ * @param digits Number of significant decimal digits to keep, from 1 to 5.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int hist_init(struct hist *h, unsigned digits);
+
+/**
+ * @brief Releases the memory of a histogram.
+ *
+ * @param h Target histogram.
+ */
+void hist_destroy(struct hist *h);
+
+/**
+ * @brief Forgets every value recorded in a histogram.
+ *
+ * @param h Target histogram.
+ */
+void hist_reset(struct hist *h);
+
+/**
+ * @brief Adds the values recorded in a histogram to another one with the same precision.
+ *
+ * @param dst Target histogram.
+ * @param src Source histogram.
+ */
+void hist_merge(struct hist *dst, const struct hist *src);
+
+/**
+ * @brief Fills a histogram with the values of another one, corrected for coordinated omission.
+ *
+ * A value larger than the expected interval between requests means that
+ * requests that should have been sent meanwhile were held back. For each of
+ * them, a value is added as if it had been sent on time and had waited: v -
+ * interval, v - 2 * interval, and so on down to the interval.
+ *
+ * @param dst      Target histogram, with the same precision as @p src.
+ * @param src      Source histogram.
+ * @param interval Expected interval between requests, zero for no correction.
+ */
+void hist_correct(struct hist *dst, const struct hist *src, uint64_t interval);
+
+/**
+ * @brief Returns the value at a percentile.
+ *
+ * @param h Target histogram.
+ * @param p Percentile, from 0 to 100.
+ *
+ * @return Largest value equivalent to the value at percentile @p p, capped at the largest recorded value.
+ */
+uint64_t hist_percentile(const struct hist *h, double p);
+
+#endif /* HIST_H_IS_INCLUDED */
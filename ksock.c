@@ -0,0 +1,685 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+/*
+ * Demikernel queue API on top of Linux kernel sockets.
+ *
+ * Queue descriptors are plain file descriptors put in non-blocking mode. Each
+ * asynchronous operation takes a slot in a token table, and operations on the
+ * same queue complete in the order in which they were issued. Every thread
+ * watches the sockets it creates with an epoll instance of its own, in
+ * edge-triggered mode: an operation is only attempted while its socket may be
+ * ready, and a wait sleeps in epoll_pwait2(2) once every candidate would block.
+ *
+ * Each thread has token and queue tables of its own, set up the first time it
+ * calls in, so threads never wait for each other. Tokens are indices in the
+ * table of the calling thread: an operation must be waited for by the thread
+ * that issued it, and a socket used by the thread that opened or accepted it.
+ */
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "ksock.h"
+#include "transport.h"
+
+/* Largest number of bytes handed out by a single pop. */
+#define KSOCK_POP_SIZE (64 * 1024)
+
+/* Largest number of readiness events taken per sleep. */
+#define KSOCK_EVENTS 64
+
+/* Readiness of a socket, as last known. */
+#define KSOCK_IN  1
+#define KSOCK_OUT 2
+
+/**
+ * @brief An asynchronous operation.
+ */
+struct ksock_op {
+	demi_opcode_t opcode;     /**< Operation, DEMI_OPC_INVALID if the slot is free. */
+	int qd;                   /**< Target queue descriptor.                         */
+	int next;                 /**< Next operation of the same kind on this queue.   */
+	int err;                  /**< Error code for a failed operation.               */
+	demi_sgarray_t sga;       /**< Pushed scatter-gather array, or popped buffer.   */
+	size_t sent;              /**< Number of bytes pushed so far.                   */
+};
+
+/**
+ * @brief Per-queue ordering of pending operations.
+ */
+struct ksock_queue {
+	int push_head;  /**< Oldest pending push, -1 if none.            */
+	int push_tail;  /**< Newest pending push, -1 if none.            */
+	int in_head;    /**< Oldest pending pop/accept, -1 if none.      */
+	int in_tail;    /**< Newest pending pop/accept, -1 if none.      */
+	unsigned ready; /**< Directions that may not block.              */
+};
+
+/**
+ * @brief Sockets and operations of a thread.
+ */
+struct ksock_thread {
+	int epfd;                   /**< Epoll instance watching the sockets of the thread. */
+	struct ksock_op *ops;       /**< Operations, indexed by token.                      */
+	int nops;                   /**< Capacity of @p ops.                                */
+	int free_op;                /**< Lowest slot of @p ops that may be free.            */
+	struct ksock_queue *queues; /**< Queues, indexed by descriptor.                     */
+	int nqueues;                /**< Capacity of @p queues.                             */
+};
+
+/* State of the calling thread. */
+static __thread struct ksock_thread *self = NULL;
+
+/* Releases the state of a thread when it exits. */
+static pthread_key_t self_key;
+static pthread_once_t self_once = PTHREAD_ONCE_INIT;
+
+/*====================================================================================================================*
+ * Internals                                                                                                          *
+ *====================================================================================================================*/
+
+/**
+ * @brief Releases the state of an exiting thread. Its sockets are left open.
+ */
+static void thread_destroy(void *arg)
+{
+	struct ksock_thread *t = arg;
+
+	for (int i = 0; i < t->nops; i++)
+	{
+		if (t->ops[i].opcode == DEMI_OPC_POP)
+			free(t->ops[i].sga.sga_buf);
+	}
+	close(t->epfd);
+	free(t->ops);
+	free(t->queues);
+	free(t);
+}
+
+/**
+ * @brief Creates the key under which the state of each thread is released.
+ */
+static void thread_key_create(void)
+{
+	pthread_key_create(&self_key, thread_destroy);
+}
+
+/**
+ * @brief Sets up the state of the calling thread, if it has none yet.
+ *
+ * @return The state, or NULL on failure with errno set.
+ */
+static struct ksock_thread *thread_get(void)
+{
+	struct ksock_thread *t = NULL;
+
+	if (self != NULL)
+		return (self);
+	if ((t = calloc(1, sizeof(struct ksock_thread))) == NULL)
+		return (NULL);
+	if ((t->epfd = epoll_create1(0)) < 0)
+	{
+		free(t);
+		return (NULL);
+	}
+	pthread_once(&self_once, thread_key_create);
+	pthread_setspecific(self_key, t);
+	self = t;
+	return (t);
+}
+
+/**
+ * @brief Returns the ordering state of a queue, growing the table if needed.
+ */
+static struct ksock_queue *queue_of(struct ksock_thread *t, int qd)
+{
+	if (qd >= t->nqueues)
+	{
+		int n = (qd + 1) * 2;
+		struct ksock_queue *q = realloc(t->queues, n * sizeof(struct ksock_queue));
+
+		if (q == NULL)
+			return (NULL);
+		for (int i = t->nqueues; i < n; i++)
+			q[i] = (struct ksock_queue){-1, -1, -1, -1, 0};
+		t->queues = q;
+		t->nqueues = n;
+	}
+	return (&t->queues[qd]);
+}
+
+/**
+ * @brief Sets up a new socket: non-blocking, watched by the calling thread, and assumed ready.
+ *
+ * @return On success, zero is returned. On failure, an error code is returned instead.
+ */
+static int queue_add(struct ksock_thread *t, int fd)
+{
+	struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.fd = fd};
+	struct ksock_queue *q = NULL;
+
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0 || epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+		return (errno);
+	if ((q = queue_of(t, fd)) == NULL)
+		return (ENOMEM);
+	*q = (struct ksock_queue){-1, -1, -1, -1, KSOCK_IN | KSOCK_OUT};
+	return (0);
+}
+
+/**
+ * @brief Takes a free operation slot.
+ */
+static int op_alloc(struct ksock_thread *t, demi_opcode_t opcode, int qd)
+{
+	int i;
+
+	for (i = t->free_op; i < t->nops && t->ops[i].opcode != DEMI_OPC_INVALID; i++)
+		;
+	if (i == t->nops)
+	{
+		int n = (t->nops == 0) ? 64 : t->nops * 2;
+		struct ksock_op *o = realloc(t->ops, n * sizeof(struct ksock_op));
+
+		if (o == NULL)
+			return (-1);
+		memset(o + t->nops, 0, (n - t->nops) * sizeof(struct ksock_op));
+		t->ops = o;
+		t->nops = n;
+	}
+	t->free_op = i + 1;
+	memset(&t->ops[i], 0, sizeof(struct ksock_op));
+	t->ops[i].opcode = opcode;
+	t->ops[i].qd = qd;
+	t->ops[i].next = -1;
+	return (i);
+}
+
+/**
+ * @brief Releases an operation slot.
+ */
+static void op_release(struct ksock_thread *t, int i)
+{
+	t->ops[i].opcode = DEMI_OPC_INVALID;
+	if (i < t->free_op)
+		t->free_op = i;
+}
+
+/**
+ * @brief Appends an operation to one of the pending lists of its queue.
+ */
+static void op_enqueue(struct ksock_thread *t, int i, int *head, int *tail)
+{
+	if (*tail >= 0)
+		t->ops[*tail].next = i;
+	else
+		*head = i;
+	*tail = i;
+}
+
+/**
+ * @brief Removes the oldest operation of one of the pending lists of a queue.
+ */
+static void op_dequeue(struct ksock_thread *t, int *head, int *tail)
+{
+	*head = t->ops[*head].next;
+	if (*head < 0)
+		*tail = -1;
+}
+
+/**
+ * @brief Returns the direction an operation waits for.
+ */
+static unsigned op_direction(const struct ksock_op *op)
+{
+	switch (op->opcode)
+	{
+	case DEMI_OPC_CONNECT:
+	case DEMI_OPC_PUSH:
+		return (KSOCK_OUT);
+	default:
+		return (KSOCK_IN);
+	}
+}
+
+/**
+ * @brief Checks whether an operation is first in line on its queue.
+ */
+static int op_is_head(struct ksock_thread *t, int i)
+{
+	struct ksock_queue *q = &t->queues[t->ops[i].qd];
+
+	switch (t->ops[i].opcode)
+	{
+	case DEMI_OPC_PUSH:
+		return (q->push_head == i);
+	case DEMI_OPC_POP:
+	case DEMI_OPC_ACCEPT:
+		return (q->in_head == i);
+	default:
+		return (1);
+	}
+}
+
+/**
+ * @brief Tries to complete an operation without blocking.
+ *
+ * @return One if the operation completed, in which case @p qr is filled in,
+ *         zero if its socket would block, and -1 if it waits behind another one.
+ */
+static int op_try(struct ksock_thread *t, int i, demi_qresult_t *qr)
+{
+	struct ksock_op *op = &t->ops[i];
+	struct ksock_queue *q = &t->queues[op->qd];
+	void *buf = NULL;
+
+	if (!op_is_head(t, i))
+		return (-1);
+
+	memset(qr, 0, sizeof(demi_qresult_t));
+	qr->qr_qd = op->qd;
+	qr->qr_qt = i;
+	qr->qr_opcode = op->opcode;
+
+	switch (op->opcode)
+	{
+	case DEMI_OPC_CONNECT:
+	{
+		struct pollfd pfd = {op->qd, POLLOUT, 0};
+		int err = 0;
+		socklen_t len = sizeof(err);
+
+		if (op->err == 0)
+		{
+			if (poll(&pfd, 1, 0) <= 0)
+				return (0);
+			getsockopt(op->qd, SOL_SOCKET, SO_ERROR, &err, &len);
+			op->err = err;
+		}
+		break;
+	}
+
+	case DEMI_OPC_ACCEPT:
+	{
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+		int fd = accept(op->qd, (struct sockaddr *)&addr, &len);
+
+		if (fd < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return (0);
+			op->err = errno;
+			op_dequeue(t, &q->in_head, &q->in_tail);
+			break;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+		/* The accepted socket is watched by the thread that accepts it, which may grow the queue table. */
+		op->err = queue_add(t, fd);
+		q = &t->queues[op->qd];
+		if (op->err != 0)
+			close(fd);
+		qr->qr_value.ares.qd = fd;
+		qr->qr_value.ares.addr = addr;
+		op_dequeue(t, &q->in_head, &q->in_tail);
+		break;
+	}
+
+	case DEMI_OPC_PUSH:
+	{
+		const demi_sgaseg_t *seg = &op->sga.sga_segs[0];
+
+		while (op->sent < seg->sgaseg_len)
+		{
+			ssize_t n = send(op->qd, (const char *)seg->sgaseg_buf + op->sent, seg->sgaseg_len - op->sent,
+					 MSG_NOSIGNAL);
+
+			if (n < 0)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return (0);
+				op->err = errno;
+				break;
+			}
+			op->sent += n;
+		}
+		qr->qr_value.sga = op->sga;
+		op_dequeue(t, &q->push_head, &q->push_tail);
+		break;
+	}
+
+	case DEMI_OPC_POP:
+	{
+		ssize_t n;
+
+		/* The buffer is kept across attempts, and handed over on completion. */
+		if (op->sga.sga_buf == NULL && (op->sga.sga_buf = malloc(KSOCK_POP_SIZE)) == NULL)
+			return (0);
+		buf = op->sga.sga_buf;
+		n = recv(op->qd, buf, KSOCK_POP_SIZE, 0);
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return (0);
+			free(buf);
+			op->err = errno;
+			op_dequeue(t, &q->in_head, &q->in_tail);
+			break;
+		}
+		qr->qr_value.sga.sga_buf = buf;
+		qr->qr_value.sga.sga_numsegs = 1;
+		qr->qr_value.sga.sga_segs[0].sgaseg_buf = buf;
+		qr->qr_value.sga.sga_segs[0].sgaseg_len = n;
+		op_dequeue(t, &q->in_head, &q->in_tail);
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	if (op->err != 0)
+	{
+		qr->qr_opcode = DEMI_OPC_FAILED;
+		qr->qr_ret = op->err;
+	}
+	op_release(t, i);
+	return (1);
+}
+
+/**
+ * @brief Computes the time left until a deadline, zero if it has passed.
+ *
+ * @return Non-zero if the deadline has passed, zero otherwise.
+ */
+static int time_left(const struct timespec *deadline, struct timespec *left)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left->tv_sec = deadline->tv_sec - now.tv_sec;
+	left->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+	if (left->tv_nsec < 0)
+	{
+		left->tv_sec--;
+		left->tv_nsec += 1000000000;
+	}
+	if (left->tv_sec < 0)
+	{
+		left->tv_sec = 0;
+		left->tv_nsec = 0;
+	}
+	return (left->tv_sec == 0 && left->tv_nsec == 0);
+}
+
+/**
+ * @brief Sleeps in epoll_pwait2(2) until an event or for some time, NULL meaning forever.
+ *
+ * Kernels older than 5.11 lack epoll_pwait2(2), and get the millisecond resolution of epoll_wait(2) instead.
+ */
+static int epoll_for(int fd, struct epoll_event *events, const struct timespec *left)
+{
+	int n = epoll_pwait2(fd, events, KSOCK_EVENTS, left, NULL);
+
+	if (n < 0 && errno == ENOSYS)
+		n = epoll_wait(fd, events, KSOCK_EVENTS,
+			       (left != NULL) ? (int)(left->tv_sec * 1000 + (left->tv_nsec + 999999) / 1000000) : -1);
+	return (n);
+}
+
+/**
+ * @brief Queues an accept, push or pop behind those of the same kind on a queue.
+ *
+ * @param qt_out Storage location for the token of the operation.
+ * @param opcode Operation.
+ * @param qd     Target queue descriptor.
+ * @param sga    Scatter-gather array to push, NULL for other operations.
+ *
+ * @return On success, zero is returned. On failure, an error code is returned instead.
+ */
+static int op_issue(demi_qtoken_t *qt_out, demi_opcode_t opcode, int qd, const demi_sgarray_t *sga)
+{
+	struct ksock_thread *t = thread_get();
+	struct ksock_queue *q = NULL;
+	int i = -1;
+
+	if (t == NULL || (i = op_alloc(t, opcode, qd)) < 0 || (q = queue_of(t, qd)) == NULL)
+	{
+		if (i >= 0)
+			op_release(t, i);
+		return (ENOMEM);
+	}
+	if (opcode == DEMI_OPC_PUSH)
+	{
+		t->ops[i].sga = *sga;
+		op_enqueue(t, i, &q->push_head, &q->push_tail);
+	}
+	else
+		op_enqueue(t, i, &q->in_head, &q->in_tail);
+	*qt_out = i;
+	return (0);
+}
+
+/*====================================================================================================================*
+ * Queue API                                                                                                          *
+ *====================================================================================================================*/
+
+int ksock_init(int argc, char *const argv[])
+{
+	(void)argc;
+	(void)argv;
+
+	return (0);
+}
+
+int ksock_socket(int *sockqd_out, int domain, int type, int protocol)
+{
+	struct ksock_thread *t = thread_get();
+	int fd = -1;
+	int err = 0;
+
+	if (t == NULL)
+		return (errno);
+	if ((fd = socket(domain, type, protocol)) < 0)
+		return (errno);
+	if ((err = queue_add(t, fd)) != 0)
+	{
+		close(fd);
+		return (err);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+	*sockqd_out = fd;
+	return (0);
+}
+
+int ksock_bind(int sockqd, const struct sockaddr *addr, socklen_t size)
+{
+	return ((bind(sockqd, addr, size) == 0) ? 0 : errno);
+}
+
+int ksock_listen(int sockqd, int backlog)
+{
+	return ((listen(sockqd, backlog) == 0) ? 0 : errno);
+}
+
+int ksock_accept(demi_qtoken_t *qt_out, int sockqd)
+{
+	return (op_issue(qt_out, DEMI_OPC_ACCEPT, sockqd, NULL));
+}
+
+int ksock_connect(demi_qtoken_t *qt_out, int sockqd, const struct sockaddr *addr, socklen_t size)
+{
+	struct ksock_thread *t = thread_get();
+	int i = -1;
+	int err = 0;
+
+	if (t == NULL)
+		return (errno);
+	setsockopt(sockqd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+	if (connect(sockqd, addr, size) != 0 && errno != EINPROGRESS)
+		err = errno;
+
+	if ((i = op_alloc(t, DEMI_OPC_CONNECT, sockqd)) < 0)
+		return (ENOMEM);
+	t->ops[i].err = err;
+	*qt_out = i;
+	return (0);
+}
+
+int ksock_close(int qd)
+{
+	struct ksock_thread *t = self;
+
+	/* Forget about anything still pending on this queue. */
+	if (t != NULL)
+	{
+		for (int i = 0; i < t->nops; i++)
+		{
+			if (t->ops[i].opcode != DEMI_OPC_INVALID && t->ops[i].qd == qd)
+			{
+				if (t->ops[i].opcode == DEMI_OPC_POP)
+					free(t->ops[i].sga.sga_buf);
+				op_release(t, i);
+			}
+		}
+		if (qd < t->nqueues)
+			t->queues[qd] = (struct ksock_queue){-1, -1, -1, -1, 0};
+	}
+
+	/* Closing the socket also removes it from the epoll instance. */
+	return ((close(qd) == 0) ? 0 : errno);
+}
+
+int ksock_push(demi_qtoken_t *qt_out, int qd, const demi_sgarray_t *sga)
+{
+	return (op_issue(qt_out, DEMI_OPC_PUSH, qd, sga));
+}
+
+int ksock_pop(demi_qtoken_t *qt_out, int qd)
+{
+	return (op_issue(qt_out, DEMI_OPC_POP, qd, NULL));
+}
+
+int ksock_wait_any(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts,
+		   const struct timespec *timeout)
+{
+	struct ksock_thread *t = thread_get();
+	struct timespec deadline;
+	struct epoll_event events[KSOCK_EVENTS];
+
+	if (t == NULL)
+		return (errno);
+	if (timeout != NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	for (;;)
+	{
+		struct timespec left;
+		int expired = 0, n;
+
+		/* Only try operations whose socket may be ready. */
+		for (int k = 0; k < num_qts; k++)
+		{
+			struct ksock_op *op = NULL;
+			int done = 0;
+
+			if (qts[k] >= (demi_qtoken_t)t->nops || t->ops[qts[k]].opcode == DEMI_OPC_INVALID)
+				return (EINVAL);
+			op = &t->ops[qts[k]];
+			if (!(t->queues[op->qd].ready & op_direction(op)))
+				continue;
+			if ((done = op_try(t, qts[k], qr_out)) == 1)
+			{
+				*ready_offset = k;
+				return (0);
+			}
+			if (done == 0)
+				t->queues[op->qd].ready &= ~op_direction(op);
+		}
+
+		/* Collect readiness even when the wait is not to block, since edge-triggered events are reported once. */
+		if (timeout != NULL)
+			expired = time_left(&deadline, &left);
+		n = epoll_for(t->epfd, events, (timeout != NULL) ? &left : NULL);
+		if (n < 0 && errno != EINTR)
+			return (errno);
+		if (n <= 0 && expired)
+			return (ETIMEDOUT);
+		for (int e = 0; e < n; e++)
+		{
+			struct ksock_queue *q = queue_of(t, events[e].data.fd);
+
+			if (q == NULL)
+				continue;
+			if (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+				q->ready |= KSOCK_IN;
+			if (events[e].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+				q->ready |= KSOCK_OUT;
+		}
+	}
+}
+
+demi_sgarray_t ksock_sgaalloc(size_t size)
+{
+	demi_sgarray_t sga = {0};
+	void *buf = malloc(size);
+
+	if (buf == NULL)
+		return (sga);
+	sga.sga_buf = buf;
+	sga.sga_numsegs = 1;
+	sga.sga_segs[0].sgaseg_buf = buf;
+	sga.sga_segs[0].sgaseg_len = size;
+	return (sga);
+}
+
+int ksock_sgafree(demi_sgarray_t *sga)
+{
+	free(sga->sga_buf);
+	sga->sga_buf = NULL;
+	return (0);
+}
+
+/**
+ * @brief Linux kernel sockets, non-blocking and watched with epoll.
+ */
+const struct transport transport_kernel = {
+	.name = "kernel",
+	.init = ksock_init,
+	.socket = ksock_socket,
+	.bind = ksock_bind,
+	.listen = ksock_listen,
+	.accept = ksock_accept,
+	.connect = ksock_connect,
+	.close = ksock_close,
+	.push = ksock_push,
+	.pop = ksock_pop,
+	.wait_any = ksock_wait_any,
+	.sgaalloc = ksock_sgaalloc,
+	.sgafree = ksock_sgafree,
+};
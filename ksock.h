@@ -0,0 +1,84 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef KSOCK_H_IS_INCLUDED
+#define KSOCK_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <time.h>
+
+#include "demi/libos.h"
+#include "demi/sga.h"
+#include "demi/wait.h"
+
+/*
+ * Demikernel queue API on top of Linux kernel sockets.
+ *
+ * Each call has the semantics of the Demikernel call of the same name, and
+ * all of them are thread-safe. Queue descriptors are file descriptors, and
+ * tokens only mean something to the thread that got them: every thread
+ * keeps its own operations and sockets, and does not share them.
+ */
+
+/**
+ * @brief Same as demi_init(). Command line arguments are ignored.
+ */
+int ksock_init(int argc, char *const argv[]);
+
+/**
+ * @brief Same as demi_socket().
+ */
+int ksock_socket(int *sockqd_out, int domain, int type, int protocol);
+
+/**
+ * @brief Same as demi_bind().
+ */
+int ksock_bind(int sockqd, const struct sockaddr *addr, socklen_t size);
+
+/**
+ * @brief Same as demi_listen().
+ */
+int ksock_listen(int sockqd, int backlog);
+
+/**
+ * @brief Same as demi_accept(). The new socket is watched by the thread that waits for the accept.
+ */
+int ksock_accept(demi_qtoken_t *qt_out, int sockqd);
+
+/**
+ * @brief Same as demi_connect().
+ */
+int ksock_connect(demi_qtoken_t *qt_out, int sockqd, const struct sockaddr *addr, socklen_t size);
+
+/**
+ * @brief Same as demi_close(). Operations still pending on the queue are dropped.
+ */
+int ksock_close(int qd);
+
+/**
+ * @brief Same as demi_push().
+ */
+int ksock_push(demi_qtoken_t *qt_out, int qd, const demi_sgarray_t *sga);
+
+/**
+ * @brief Same as demi_pop().
+ */
+int ksock_pop(demi_qtoken_t *qt_out, int qd);
+
+/**
+ * @brief Same as demi_wait_any().
+ */
+int ksock_wait_any(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts,
+		   const struct timespec *timeout);
+
+/**
+ * @brief Same as demi_sgaalloc().
+ */
+demi_sgarray_t ksock_sgaalloc(size_t size);
+
+/**
+ * @brief Same as demi_sgafree().
+ */
+int ksock_sgafree(demi_sgarray_t *sga);
+
+#endif /* KSOCK_H_IS_INCLUDED */
@@ -0,0 +1,133 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+/*
+ * Stand-in for libdemikernel on top of Linux kernel sockets.
+ *
+ * Every call is forwarded to the kernel sockets backend in ksock.c, so
+ * programs written against the Demikernel API run unchanged without DPDK.
+ * Latency is that of the kernel stack, so numbers taken with this library
+ * say nothing about Demikernel itself.
+ */
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <time.h>
+
+#include "demi/libos.h"
+#include "demi/sga.h"
+#include "demi/wait.h"
+
+#include "../ksock.h"
+
+/*====================================================================================================================*
+ * demi/libos.h                                                                                                       *
+ *====================================================================================================================*/
+
+int demi_init(int argc, char *const argv[])
+{
+	return (ksock_init(argc, argv));
+}
+
+int demi_create_pipe(int *memqd_out, const char *name)
+{
+	(void)memqd_out;
+	(void)name;
+
+	return (ENOTSUP);
+}
+
+int demi_open_pipe(int *memqd_out, const char *name)
+{
+	(void)memqd_out;
+	(void)name;
+
+	return (ENOTSUP);
+}
+
+int demi_socket(int *sockqd_out, int domain, int type, int protocol)
+{
+	return (ksock_socket(sockqd_out, domain, type, protocol));
+}
+
+int demi_listen(int sockqd, int backlog)
+{
+	return (ksock_listen(sockqd, backlog));
+}
+
+int demi_bind(int sockqd, const struct sockaddr *addr, socklen_t size)
+{
+	return (ksock_bind(sockqd, addr, size));
+}
+
+int demi_accept(demi_qtoken_t *qt_out, int sockqd)
+{
+	return (ksock_accept(qt_out, sockqd));
+}
+
+int demi_connect(demi_qtoken_t *qt_out, int sockqd, const struct sockaddr *addr, socklen_t size)
+{
+	return (ksock_connect(qt_out, sockqd, addr, size));
+}
+
+int demi_close(int qd)
+{
+	return (ksock_close(qd));
+}
+
+int demi_push(demi_qtoken_t *qt_out, int qd, const demi_sgarray_t *sga)
+{
+	return (ksock_push(qt_out, qd, sga));
+}
+
+int demi_pushto(demi_qtoken_t *qt_out, int sockqd, const demi_sgarray_t *sga, const struct sockaddr *dest_addr,
+		socklen_t size)
+{
+	(void)qt_out;
+	(void)sockqd;
+	(void)sga;
+	(void)dest_addr;
+	(void)size;
+
+	return (ENOTSUP);
+}
+
+int demi_pop(demi_qtoken_t *qt_out, int qd)
+{
+	return (ksock_pop(qt_out, qd));
+}
+
+/*====================================================================================================================*
+ * demi/sga.h                                                                                                         *
+ *====================================================================================================================*/
+
+demi_sgarray_t demi_sgaalloc(size_t size)
+{
+	return (ksock_sgaalloc(size));
+}
+
+int demi_sgafree(demi_sgarray_t *sga)
+{
+	return (ksock_sgafree(sga));
+}
+
+/*====================================================================================================================*
+ * demi/wait.h                                                                                                        *
+ *====================================================================================================================*/
+
+int demi_wait_any(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts,
+		  const struct timespec *timeout)
+{
+	return (ksock_wait_any(qr_out, ready_offset, qts, num_qts, timeout));
+}
+
+int demi_wait(demi_qresult_t *qr_out, demi_qtoken_t qt, const struct timespec *timeout)
+{
+	int offset = -1;
+
+	return (demi_wait_any(qr_out, &offset, &qt, 1, timeout));
+}
@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <assert.h>
+
+#include "msg.h"
+
+/**
+ * @brief Feeds received bytes to the message being reassembled.
+ *
+ * The header is copied aside as it arrives, since it may be split across
+ * several pops. With prefix framing, the length of the message is only known
+ * once the whole header has been received.
+ *
+ * @param f        Target frame.
+ * @param buf      Received bytes.
+ * @param len      Number of received bytes.
+ * @param expected Length of the message being received (fixed framing).
+ * @param framing  How messages are delimited.
+ *
+ * @return Number of bytes that belong to the message, the rest belongs to the next ones, or -1 if the header
+ * announces a length shorter than itself. Such a length comes from the peer, so it is not trusted.
+ */
+ssize_t rx_feed(struct rx_frame *f, const void *buf, size_t len, size_t expected, enum framing framing)
+{
+	const uint8_t *p = buf;
+	size_t used = 0;
+
+	if (f->got == 0 && framing == FRAMING_FIXED)
+	{
+		assert(expected >= sizeof(struct msg_hdr));
+		f->len = expected;
+	}
+
+	/* Copy the header aside. */
+	if (f->got < sizeof(struct msg_hdr))
+	{
+		size_t n = sizeof(struct msg_hdr) - f->got;
+
+		n = (n < len) ? n : len;
+		memcpy((uint8_t *)&f->hdr + f->got, p, n);
+		f->got += n;
+		used += n;
+
+		if (framing == FRAMING_PREFIX && f->got == sizeof(struct msg_hdr))
+		{
+			if (f->hdr.len < sizeof(struct msg_hdr))
+				return (-1);
+			f->len = f->hdr.len;
+		}
+	}
+
+	/* Skip over the payload. */
+	if (f->len != 0)
+	{
+		size_t n = f->len - f->got;
+
+		n = (n < len - used) ? n : len - used;
+		f->got += n;
+		used += n;
+	}
+
+	return ((ssize_t)used);
+}
+
+/**
+ * @brief Checks the header of an echo against the one expected next on a connection.
+ *
+ * Sequence numbers wrap around, which is fine as long as fewer than 32768
+ * messages are outstanding on a connection.
+ *
+ * @param hdr      Echoed header.
+ * @param conn     Connection the echo was received on.
+ * @param next_seq Sequence number expected next, advanced past the echo.
+ * @param stats    Anomaly counters to update.
+ */
+void msg_check(const struct msg_hdr *hdr, uint16_t conn, uint16_t *next_seq, struct seq_stats *stats)
+{
+	int16_t ahead = (int16_t)(hdr->seq - *next_seq);
+
+	if (hdr->conn != conn)
+	{
+		stats->misrouted++;
+		return;
+	}
+
+	if (ahead < 0)
+	{
+		stats->reordered++;
+		return;
+	}
+
+	stats->lost += ahead;
+	*next_seq = hdr->seq + 1;
+}
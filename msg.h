@@ -0,0 +1,106 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSG_H_IS_INCLUDED
+#define MSG_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+/**
+ * @brief How echoed messages are delimited in the received byte stream.
+ */
+enum framing {
+	FRAMING_FIXED,  /**< Each echo is as long as the request it answers. */
+	FRAMING_PREFIX, /**< Each echo starts with its length.               */
+};
+
+/**
+ * @brief Header at the start of every message, in the space reserved by the server.
+ */
+struct __attribute__((__packed__)) msg_hdr {
+	uint32_t len;  /**< Length of the message, header included (prefix framing). */
+	uint16_t conn; /**< Connection the message was sent on.                       */
+	uint16_t seq;  /**< Sequence number of the message on its connection.         */
+	uint64_t tsc;  /**< Time-stamp counter when the message was due to be sent.   */
+};
+
+/**
+ * @brief Anomalies detected in the sequence of echoed headers.
+ */
+struct seq_stats {
+	uint64_t lost;      /**< Messages skipped over by a later echo.      */
+	uint64_t reordered; /**< Echoes older than the one expected.         */
+	uint64_t misrouted; /**< Echoes received on another connection.      */
+};
+
+/**
+ * @brief Reassembly state of the message being received.
+ */
+struct rx_frame {
+	size_t len;          /**< Length of the message, zero while unknown.  */
+	size_t got;          /**< Number of bytes received so far.            */
+	struct msg_hdr hdr;  /**< Header, once the first bytes have arrived.  */
+};
+
+/**
+ * @brief Writes a message header at the start of a buffer.
+ *
+ * @param buf Target buffer.
+ * @param hdr Header to write.
+ */
+static inline void msg_write_hdr(void *buf, const struct msg_hdr *hdr)
+{
+	memcpy(buf, hdr, sizeof(struct msg_hdr));
+}
+
+/**
+ * @brief Checks whether a message has been fully received.
+ *
+ * @param f Target frame.
+ *
+ * @return Non-zero if every byte of the message has arrived, zero otherwise.
+ */
+static inline int rx_done(const struct rx_frame *f)
+{
+	return (f->len != 0 && f->got == f->len);
+}
+
+/**
+ * @brief Starts the reception of the next message.
+ *
+ * @param f Target frame.
+ */
+static inline void rx_reset(struct rx_frame *f)
+{
+	f->len = 0;
+	f->got = 0;
+}
+
+/**
+ * @brief Feeds received bytes to the message being reassembled.
+ *
+ * @param f        Target frame.
+ * @param buf      Received bytes.
+ * @param len      Number of received bytes.
+ * @param expected Length of the message being received (fixed framing).
+ * @param framing  How messages are delimited.
+ *
+ * @return Number of bytes that belong to the message, the rest belongs to the next ones, or -1 if the header
+ * announces a length shorter than itself.
+ */
+ssize_t rx_feed(struct rx_frame *f, const void *buf, size_t len, size_t expected, enum framing framing);
+
+/**
+ * @brief Checks the header of an echo against the one expected next on a connection.
+ *
+ * @param hdr      Echoed header.
+ * @param conn     Connection the echo was received on.
+ * @param next_seq Sequence number expected next, advanced past the echo.
+ * @param stats    Anomaly counters to update.
+ */
+void msg_check(const struct msg_hdr *hdr, uint16_t conn, uint16_t *next_seq, struct seq_stats *stats);
+
+#endif /* MSG_H_IS_INCLUDED */
@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "samplelog.h"
+#include "tsc.h"
+
+/* Number of bytes mapped at a time. A multiple of the page and sample sizes. */
+#define SAMPLE_LOG_CHUNK (16 * 1024 * 1024)
+
+/**
+ * @brief Writes the header of a sample log.
+ */
+static int sample_log_write_hdr(const struct sample_log *l)
+{
+	struct sample_log_hdr hdr;
+
+	memset(&hdr, 0, sizeof(struct sample_log_hdr));
+	memcpy(hdr.magic, SAMPLE_LOG_MAGIC, sizeof(hdr.magic));
+	hdr.sample_size = sizeof(struct sample);
+	hdr.thread = l->thread;
+	hdr.tsc_hz = tsc_hz();
+	hdr.count = l->count;
+	hdr.overhead = tsc_overhead();
+	return ((pwrite(l->fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) ? 0 : -1);
+}
+
+/**
+ * @brief Opens a sample log.
+ *
+ * @param l      Target log.
+ * @param path   Path to the file, truncated if it exists, NULL to disable logging.
+ * @param thread Thread that takes the samples.
+ * @param origin TSC value that send times are relative to, the same for every log of a run.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int sample_log_open(struct sample_log *l, const char *path, uint32_t thread, uint64_t origin)
+{
+	memset(l, 0, sizeof(struct sample_log));
+	l->fd = -1;
+	if (path == NULL)
+		return (0);
+
+	l->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (l->fd < 0)
+		return (-1);
+	l->thread = thread;
+	l->origin = origin;
+	if (sample_log_write_hdr(l) != 0 || sample_log_grow(l) != 0)
+	{
+		close(l->fd);
+		l->fd = -1;
+		return (-1);
+	}
+
+	/* The header shares the first chunk with samples. */
+	l->next += sizeof(struct sample_log_hdr) / sizeof(struct sample);
+	return (0);
+}
+
+/**
+ * @brief Maps the next chunk of a sample log.
+ *
+ * @param l Target log.
+ *
+ * @return On success, zero is returned. On failure, or if logging is disabled, -1 is returned instead.
+ */
+int sample_log_grow(struct sample_log *l)
+{
+	void *chunk = NULL;
+	off_t offset = (off_t)l->nchunks * SAMPLE_LOG_CHUNK;
+
+	if (l->fd < 0)
+		return (-1);
+	if (l->chunk != NULL)
+	{
+		munmap(l->chunk, SAMPLE_LOG_CHUNK);
+		l->chunk = l->next = l->limit = NULL;
+	}
+
+	if (ftruncate(l->fd, offset + SAMPLE_LOG_CHUNK) != 0)
+		return (-1);
+	chunk = mmap(NULL, SAMPLE_LOG_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, l->fd, offset);
+	if (chunk == MAP_FAILED)
+		return (-1);
+	posix_madvise(chunk, SAMPLE_LOG_CHUNK, POSIX_MADV_SEQUENTIAL);
+
+	l->nchunks++;
+	l->chunk = l->next = chunk;
+	l->limit = l->chunk + SAMPLE_LOG_CHUNK / sizeof(struct sample);
+	return (0);
+}
+
+/**
+ * @brief Completes a sample log: writes the number of samples and trims the file.
+ *
+ * @param l Target log.
+ */
+void sample_log_close(struct sample_log *l)
+{
+	if (l->fd < 0)
+		return;
+	if (l->chunk != NULL)
+		munmap(l->chunk, SAMPLE_LOG_CHUNK);
+	sample_log_write_hdr(l);
+	if (ftruncate(l->fd, sizeof(struct sample_log_hdr) + l->count * sizeof(struct sample)) != 0)
+		perror("ftruncate()");
+	close(l->fd);
+	l->fd = -1;
+	l->chunk = l->next = l->limit = NULL;
+}
@@ -0,0 +1,112 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef SAMPLELOG_H_IS_INCLUDED
+#define SAMPLELOG_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Identifies sample log files.
+ */
+#define SAMPLE_LOG_MAGIC "DEMISMP1"
+
+/**
+ * @brief A latency sample, as laid out in a sample log.
+ */
+struct sample {
+	uint64_t sent;     /**< Send time in TSC ticks since the origin.          */
+	uint64_t latency;  /**< Round-trip time in TSC ticks.                     */
+	uint32_t size;     /**< Number of bytes in the request.                   */
+	uint32_t conn;     /**< Connection the request was sent on.               */
+	uint32_t run;      /**< Run the sample belongs to, numbered from zero.    */
+	uint32_t reserved; /**< Zero.                                             */
+};
+
+/**
+ * @brief Header at the start of a sample log, followed by the samples.
+ */
+struct sample_log_hdr {
+	char magic[8];        /**< SAMPLE_LOG_MAGIC, not NUL-terminated. */
+	uint32_t sample_size; /**< Size of a sample in bytes.            */
+	uint32_t thread;      /**< Thread that took the samples.         */
+	uint64_t tsc_hz;      /**< Frequency of the TSC.                 */
+	uint64_t count;       /**< Number of samples.                    */
+	uint64_t overhead;    /**< Ticks spent reading the TSC.          */
+	uint8_t reserved[24]; /**< Zero.                                 */
+};
+
+/**
+ * @brief A binary file of latency samples, written sequentially through a memory mapping.
+ *
+ * The file is mapped a chunk at a time, so that writing a sample is a store
+ * into memory and the kernel writes pages back in the background. The file
+ * grows by one chunk whenever the current one is full.
+ */
+struct sample_log {
+	int fd;               /**< Underlying file, -1 if logging is disabled. */
+	uint64_t origin;      /**< TSC value send times are relative to.       */
+	uint32_t thread;      /**< Thread that takes the samples.              */
+	uint32_t run;         /**< Run that samples are added to.              */
+	struct sample *chunk; /**< Mapped chunk of the file.                   */
+	size_t nchunks;       /**< Number of chunks mapped so far.             */
+	struct sample *next;  /**< Where the next sample goes.                 */
+	struct sample *limit; /**< End of the mapped chunk.                    */
+	uint64_t count;       /**< Number of samples written.                  */
+	uint64_t dropped;     /**< Samples lost because the file could not grow. */
+};
+
+/**
+ * @brief Opens a sample log.
+ *
+ * @param l      Target log.
+ * @param path   Path to the file, truncated if it exists, NULL to disable logging.
+ * @param thread Thread that takes the samples.
+ * @param origin TSC value that send times are relative to, the same for every log of a run.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int sample_log_open(struct sample_log *l, const char *path, uint32_t thread, uint64_t origin);
+
+/**
+ * @brief Maps the next chunk of a sample log.
+ *
+ * @param l Target log.
+ *
+ * @return On success, zero is returned. On failure, or if logging is disabled, -1 is returned instead.
+ */
+int sample_log_grow(struct sample_log *l);
+
+/**
+ * @brief Completes a sample log: writes the number of samples and trims the file.
+ *
+ * @param l Target log.
+ */
+void sample_log_close(struct sample_log *l);
+
+/**
+ * @brief Appends a sample to a log.
+ *
+ * @param l       Target log.
+ * @param sent    TSC value at which the request was sent.
+ * @param latency Round-trip time in TSC ticks.
+ * @param size    Number of bytes in the request.
+ * @param conn    Connection the request was sent on.
+ */
+static inline void sample_log_add(struct sample_log *l, uint64_t sent, uint64_t latency, uint32_t size,
+				  uint32_t conn)
+{
+	if (l->fd < 0)
+		return;
+	if (l->next == l->limit && sample_log_grow(l) != 0)
+	{
+		l->dropped++;
+		return;
+	}
+	*l->next++ = (struct sample){
+		.sent = sent - l->origin, .latency = latency, .size = size, .conn = conn, .run = l->run};
+	l->count++;
+}
+
+#endif /* SAMPLELOG_H_IS_INCLUDED */
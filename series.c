@@ -0,0 +1,200 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "series.h"
+#include "tsc.h"
+
+/**
+ * @brief Returns the middle of the latencies counted by a bucket of the histogram of a window.
+ */
+static uint64_t series_value(unsigned b)
+{
+	unsigned e = 0;
+
+	if (b < (2u << SERIES_SUB_BITS))
+		return (b);
+	e = (b >> SERIES_SUB_BITS) + SERIES_SUB_BITS - 1;
+	return ((((1ull << SERIES_SUB_BITS) + (b & ((1u << SERIES_SUB_BITS) - 1))) << (e - SERIES_SUB_BITS)) +
+		(1ull << (e - SERIES_SUB_BITS)) / 2);
+}
+
+/**
+ * @brief Returns the latency below which a given percentage of the samples of the current window fall.
+ */
+static uint64_t series_percentile(const struct series *s, double percent)
+{
+	uint64_t rank = (uint64_t)(percent / 100 * s->count + 0.5);
+	uint64_t seen = 0;
+
+	if (rank == 0)
+		rank = 1;
+	for (unsigned b = 0; b < SERIES_BUCKETS; b++)
+	{
+		seen += s->buckets[b];
+		if (seen >= rank)
+			return ((series_value(b) < s->max) ? series_value(b) : s->max);
+	}
+	return (s->max);
+}
+
+/**
+ * @brief Prints the summary of a window.
+ */
+static void series_print_point(const struct series *s, FILE *fp, const struct series_point *p)
+{
+	double start = (double)p->index * s->width * 1000 / tsc_hz();
+
+	fprintf(fp, "%8s %10.1f %10lu %10lu %10lu %10lu %10lu\n", s->label, start, p->count, tsc_to_ns(p->mean),
+		tsc_to_ns(p->p50), tsc_to_ns(p->p99), tsc_to_ns(p->max));
+}
+
+/**
+ * @brief Initializes a series.
+ *
+ * @param s        Target series.
+ * @param width    Width of a window in TSC ticks, zero to disable the series.
+ * @param capacity Number of windows kept.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int series_init(struct series *s, uint64_t width, size_t capacity)
+{
+	memset(s, 0, sizeof(struct series));
+	if (width == 0)
+		return (0);
+	if (capacity == 0)
+		return (-1);
+	s->buckets = calloc(SERIES_BUCKETS, sizeof(uint32_t));
+	s->points = calloc(capacity, sizeof(struct series_point));
+	if (s->buckets == NULL || s->points == NULL)
+	{
+		free(s->buckets);
+		free(s->points);
+		return (-1);
+	}
+	s->width = width;
+	s->capacity = capacity;
+	return (0);
+}
+
+/**
+ * @brief Releases the memory of a series.
+ *
+ * @param s Target series.
+ */
+void series_destroy(struct series *s)
+{
+	if (s->width == 0)
+		return;
+	free(s->buckets);
+	free(s->points);
+	s->buckets = NULL;
+	s->points = NULL;
+	s->width = 0;
+}
+
+/**
+ * @brief Empties the histogram of the current window.
+ */
+static void series_reset(struct series *s)
+{
+	memset(s->buckets, 0, SERIES_BUCKETS * sizeof(uint32_t));
+	s->count = 0;
+	s->sum = 0;
+	s->max = 0;
+}
+
+/**
+ * @brief Forgets every window of a series and starts the first one.
+ *
+ * @param s      Target series.
+ * @param origin TSC value at which the first window starts.
+ */
+void series_start(struct series *s, uint64_t origin)
+{
+	if (s->width == 0)
+		return;
+	series_reset(s);
+	s->origin = origin;
+	s->end = origin + s->width;
+	s->closed = 0;
+}
+
+/**
+ * @brief Closes every window that ended before a given time.
+ *
+ * Windows without samples are kept too, so that gaps show. At most one ring
+ * worth of them is written after a long gap, since older ones would be
+ * overwritten anyway.
+ *
+ * @param s   Target series.
+ * @param now Current TSC value.
+ */
+void series_close(struct series *s, uint64_t now)
+{
+	uint64_t n = 0;
+
+	if (s->width == 0 || now < s->end)
+		return;
+
+	/* Windows to close, the current one included. */
+	n = (now - s->end) / s->width + 1;
+	s->end += n * s->width;
+
+	for (; n > 0; n--)
+	{
+		struct series_point *p = &s->points[s->closed % s->capacity];
+
+		memset(p, 0, sizeof(struct series_point));
+		p->index = s->closed++;
+		if (s->count > 0)
+		{
+			p->count = s->count;
+			p->mean = s->sum / s->count;
+			p->p50 = series_percentile(s, 50);
+			p->p99 = series_percentile(s, 99);
+			p->max = s->max;
+			series_reset(s);
+		}
+		if (s->live != NULL)
+			series_print_point(s, s->live, p);
+
+		/* Skip empty windows that would be overwritten before the ring is read. */
+		if (n - 1 > s->capacity)
+		{
+			s->closed += n - 1 - s->capacity;
+			n = s->capacity + 1;
+		}
+	}
+}
+
+/**
+ * @brief Prints the column names of time series. Times are in milliseconds and latencies in nanoseconds.
+ *
+ * @param fp Target stream.
+ */
+void series_print_header(FILE *fp)
+{
+	fprintf(fp, "%8s %10s %10s %10s %10s %10s %10s\n", "series", "t (ms)", "msgs", "mean", "p50", "p99", "max");
+}
+
+/**
+ * @brief Prints the windows kept in a series, oldest first.
+ *
+ * @param s  Target series.
+ * @param fp Target stream.
+ */
+void series_print(const struct series *s, FILE *fp)
+{
+	uint64_t first = (s->closed > s->capacity) ? s->closed - s->capacity : 0;
+
+	if (s->width == 0)
+		return;
+	if (first > 0)
+		fprintf(fp, "%8s %lu earlier windows dropped, consider a wider --interval\n", s->label, first);
+	for (uint64_t i = first; i < s->closed; i++)
+		series_print_point(s, fp, &s->points[i % s->capacity]);
+}
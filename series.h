@@ -0,0 +1,142 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef SERIES_H_IS_INCLUDED
+#define SERIES_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Number of sub-buckets per power of two in the histogram of a window, as a power of two.
+ */
+#define SERIES_SUB_BITS 4
+
+/**
+ * @brief Number of buckets in the histogram of a window: values below 2^(SERIES_SUB_BITS + 1) are exact.
+ */
+#define SERIES_BUCKETS ((65 - SERIES_SUB_BITS) << SERIES_SUB_BITS)
+
+/**
+ * @brief Latency summary of a window of time.
+ */
+struct series_point {
+	uint64_t index; /**< Number of the window since the origin. */
+	uint64_t count; /**< Number of samples.                     */
+	uint64_t mean;  /**< Mean latency in TSC ticks.             */
+	uint64_t p50;   /**< Median latency in TSC ticks.           */
+	uint64_t p99;   /**< 99th percentile in TSC ticks.          */
+	uint64_t max;   /**< Largest latency in TSC ticks.          */
+};
+
+/**
+ * @brief Latency over time, in windows of fixed width.
+ *
+ * Samples go into a coarse histogram for the current window, which is
+ * summarized into a preallocated ring when a sample arrives past its end.
+ * Once the ring is full, the oldest windows are overwritten. The histogram
+ * has SERIES_BUCKETS counters, within 1/32 of the latencies they count, so
+ * that closing a window on the measured path only scans and clears a few
+ * kilobytes. Means and maxima are exact.
+ */
+struct series {
+	uint64_t width;              /**< Width of a window in TSC ticks, zero if disabled. */
+	uint64_t origin;             /**< Start of the first window.                        */
+	uint64_t end;                /**< End of the current window.                        */
+	uint64_t closed;             /**< Number of windows closed since the origin.        */
+	uint64_t count;              /**< Number of samples in the current window.          */
+	uint64_t sum;                /**< Sum of the samples in the current window.         */
+	uint64_t max;                /**< Largest sample in the current window.             */
+	uint32_t *buckets;           /**< Histogram of the current window.                  */
+	struct series_point *points; /**< Closed windows, oldest overwritten first.         */
+	size_t capacity;             /**< Number of windows kept.                           */
+	FILE *live;                  /**< Where to print windows as they close, or NULL.    */
+	char label[12];              /**< Name of the series in printed rows.               */
+};
+
+/**
+ * @brief Initializes a series.
+ *
+ * @param s        Target series.
+ * @param width    Width of a window in TSC ticks, zero to disable the series.
+ * @param capacity Number of windows kept.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int series_init(struct series *s, uint64_t width, size_t capacity);
+
+/**
+ * @brief Releases the memory of a series.
+ *
+ * @param s Target series.
+ */
+void series_destroy(struct series *s);
+
+/**
+ * @brief Forgets every window of a series and starts the first one.
+ *
+ * @param s      Target series.
+ * @param origin TSC value at which the first window starts.
+ */
+void series_start(struct series *s, uint64_t origin);
+
+/**
+ * @brief Closes every window that ended before a given time.
+ *
+ * @param s   Target series.
+ * @param now Current TSC value.
+ */
+void series_close(struct series *s, uint64_t now);
+
+/**
+ * @brief Returns the bucket of a latency in the histogram of a window.
+ */
+static inline unsigned series_bucket(uint64_t v)
+{
+	unsigned e = 0;
+
+	if (v < (2u << SERIES_SUB_BITS))
+		return ((unsigned)v);
+	/* Power of two, then the SERIES_SUB_BITS bits below the leading one. */
+	e = 63 - __builtin_clzll(v);
+	return (((e - SERIES_SUB_BITS + 1) << SERIES_SUB_BITS) +
+		(unsigned)((v >> (e - SERIES_SUB_BITS)) & ((1u << SERIES_SUB_BITS) - 1)));
+}
+
+/**
+ * @brief Records a latency sample.
+ *
+ * @param s   Target series.
+ * @param now TSC value at which the sample was taken.
+ * @param v   Latency in TSC ticks.
+ */
+static inline void series_record(struct series *s, uint64_t now, uint64_t v)
+{
+	if (s->width == 0)
+		return;
+	if (now >= s->end)
+		series_close(s, now);
+	s->buckets[series_bucket(v)]++;
+	s->count++;
+	s->sum += v;
+	if (v > s->max)
+		s->max = v;
+}
+
+/**
+ * @brief Prints the column names of time series. Times are in milliseconds and latencies in nanoseconds.
+ *
+ * @param fp Target stream.
+ */
+void series_print_header(FILE *fp);
+
+/**
+ * @brief Prints the windows kept in a series, oldest first.
+ *
+ * @param s  Target series.
+ * @param fp Target stream.
+ */
+void series_print(const struct series *s, FILE *fp);
+
+#endif /* SERIES_H_IS_INCLUDED */
@@ -0,0 +1,370 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+// Needed for getopt_long().
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "demi/libos.h"
+#include "demi/sga.h"
+#include "demi/wait.h"
+
+#include "common.h"
+
+#define BATCH   32
+#define BACKLOG 128
+
+/* How often blocking waits check whether the server has been asked to stop. */
+#define STOP_CHECK_NS (100 * 1000 * 1000)
+
+/**
+ * @brief Operations pending on every queue of the server.
+ */
+struct server_ops {
+	demi_qtoken_t *qts;   /**< Pending operations, as passed to demi_wait_any(). */
+	int *qds;             /**< Queue of each operation.                          */
+	demi_sgarray_t *sgas; /**< Echoed data of pushes.                            */
+	unsigned n;           /**< Number of pending operations.                     */
+	unsigned capacity;    /**< Number of operations the table can hold.          */
+};
+
+/**
+ * @brief Data popped in a batch, pushed back once the batch is complete.
+ */
+struct echo {
+	int qd;             /**< Connection the data came from. */
+	demi_sgarray_t sga; /**< Popped data, pushed as is.     */
+};
+
+/**
+ * @brief Counters of a server run.
+ */
+struct server_stats {
+	uint64_t conns;   /**< Connections accepted.       */
+	uint64_t echoes;  /**< Pushes completed.           */
+	uint64_t bytes;   /**< Bytes echoed.               */
+	uint64_t batches; /**< Wake-ups of the event loop. */
+};
+
+/*====================================================================================================================*
+ * ops_add()                                                                                                          *
+ *====================================================================================================================*/
+
+/**
+ * @brief Appends a pending operation, growing the table if needed.
+ *
+ * @param ops Target table.
+ * @param qt  Token of the operation.
+ * @param qd  Queue of the operation.
+ * @param sga Echoed data for a push, NULL otherwise.
+ */
+static void ops_add(struct server_ops *ops, demi_qtoken_t qt, int qd, const demi_sgarray_t *sga)
+{
+	if (ops->n == ops->capacity)
+	{
+		ops->capacity = (ops->capacity > 0) ? 2 * ops->capacity : 64;
+		ops->qts = realloc(ops->qts, ops->capacity * sizeof(demi_qtoken_t));
+		ops->qds = realloc(ops->qds, ops->capacity * sizeof(int));
+		ops->sgas = realloc(ops->sgas, ops->capacity * sizeof(demi_sgarray_t));
+		assert(ops->qts != NULL && ops->qds != NULL && ops->sgas != NULL);
+	}
+	ops->qts[ops->n] = qt;
+	ops->qds[ops->n] = qd;
+	if (sga != NULL)
+		ops->sgas[ops->n] = *sga;
+	else
+		memset(&ops->sgas[ops->n], 0, sizeof(demi_sgarray_t));
+	ops->n++;
+}
+
+/**
+ * @brief Removes a completed operation, moving the last one in its place.
+ */
+static void ops_remove(struct server_ops *ops, unsigned i)
+{
+	ops->n--;
+	ops->qts[i] = ops->qts[ops->n];
+	ops->qds[i] = ops->qds[ops->n];
+	ops->sgas[i] = ops->sgas[ops->n];
+}
+
+/**
+ * @brief Closes a connection and forgets its pending operations and the data it has yet to echo.
+ *
+ * @param ops    Pending operations.
+ * @param batch  Data popped so far in this batch.
+ * @param nbatch Number of entries in @p batch.
+ * @param qd     Target connection.
+ */
+static void conn_drop(struct server_ops *ops, struct echo *batch, unsigned *nbatch, int qd)
+{
+	for (unsigned i = 0; i < *nbatch;)
+	{
+		if (batch[i].qd != qd)
+		{
+			i++;
+			continue;
+		}
+		demi_sgafree(&batch[i].sga);
+		batch[i] = batch[--(*nbatch)];
+	}
+	for (unsigned i = 0; i < ops->n;)
+	{
+		if (ops->qds[i] != qd)
+		{
+			i++;
+			continue;
+		}
+		if (ops->sgas[i].sga_numsegs != 0)
+			demi_sgafree(&ops->sgas[i]);
+		ops_remove(ops, i);
+	}
+	demi_close(qd);
+}
+
+/*====================================================================================================================*
+ * server()                                                                                                           *
+ *====================================================================================================================*/
+
+/**
+ * @brief Handles a completed operation.
+ *
+ * Popped data is set aside in @p batch rather than pushed right away, so that
+ * the pushes of a batch go out back to back.
+ *
+ * @param ops    Pending operations.
+ * @param offset Index of the operation in @p ops.
+ * @param qr     Result of the operation.
+ * @param lqd    Listening queue.
+ * @param batch  Data popped so far in this batch.
+ * @param nbatch Number of entries in @p batch.
+ * @param stats  Counters.
+ */
+static void server_complete(struct server_ops *ops, int offset, demi_qresult_t *qr, int lqd,
+			    struct echo *batch, unsigned *nbatch, struct server_stats *stats)
+{
+	demi_qtoken_t qt = -1;
+	int qd = ops->qds[offset];
+	demi_sgarray_t pushed = ops->sgas[offset];
+
+	ops_remove(ops, offset);
+	switch (qr->qr_opcode)
+	{
+	case DEMI_OPC_ACCEPT:
+		/* Keep an accept posted, and one pop on every connection. */
+		assert(demi_accept(&qt, lqd) == 0);
+		ops_add(ops, qt, lqd, NULL);
+		assert(demi_pop(&qt, qr->qr_value.ares.qd) == 0);
+		ops_add(ops, qt, qr->qr_value.ares.qd, NULL);
+		stats->conns++;
+		break;
+
+	case DEMI_OPC_POP:
+		/* The peer closed the connection. */
+		if (qr->qr_value.sga.sga_numsegs == 0 || qr->qr_value.sga.sga_segs[0].sgaseg_len == 0)
+		{
+			if (qr->qr_value.sga.sga_numsegs != 0)
+				demi_sgafree(&qr->qr_value.sga);
+			conn_drop(ops, batch, nbatch, qd);
+			break;
+		}
+		batch[*nbatch].qd = qd;
+		batch[(*nbatch)++].sga = qr->qr_value.sga;
+		break;
+
+	case DEMI_OPC_PUSH:
+		stats->echoes++;
+		stats->bytes += pushed.sga_segs[0].sgaseg_len;
+		assert(demi_sgafree(&pushed) == 0);
+		break;
+
+	case DEMI_OPC_FAILED:
+		/* Connection reset, or the listening socket failed. */
+		if (pushed.sga_numsegs != 0)
+			demi_sgafree(&pushed);
+		if (qd == lqd)
+		{
+			fprintf(stderr, "accept failed: %s\n", strerror(qr->qr_ret));
+			stop_requested = 1;
+		}
+		else
+			conn_drop(ops, batch, nbatch, qd);
+		break;
+
+	default:
+		assert(0 && "unexpected operation");
+	}
+}
+
+/**
+ * @brief TCP echo server.
+ *
+ * Every connection has at most one pop posted. Each wake-up handles up to
+ * @p batch_size completed operations, the first one waited for and the rest
+ * already done. The data popped during a wake-up is then pushed back as is,
+ * without a copy, and freed when the push completes. The pops of the batch
+ * are reposted after all of its pushes, so that a busy connection cannot
+ * starve the others.
+ *
+ * @param argc       Argument count.
+ * @param argv       Argument list.
+ * @param local      Local socket address.
+ * @param batch_size Largest number of operations handled per wake-up.
+ */
+static void server(int argc, char *const argv[], const struct sockaddr_in *local, unsigned batch_size)
+{
+	struct server_ops ops = {0};
+	struct server_stats stats = {0};
+	struct echo *batch = calloc(batch_size, sizeof(struct echo));
+	demi_qtoken_t qt = -1;
+	int lqd = -1;
+
+	assert(batch != NULL);
+
+	/* Initialize demikernel */
+	assert(demi_init(argc, argv) == 0);
+
+	/* Setup socket. */
+	assert(demi_socket(&lqd, AF_INET, SOCK_STREAM, 0) == 0);
+	assert(demi_bind(lqd, (const struct sockaddr *)local, sizeof(struct sockaddr_in)) == 0);
+	assert(demi_listen(lqd, BACKLOG) == 0);
+	assert(demi_accept(&qt, lqd) == 0);
+	ops_add(&ops, qt, lqd, NULL);
+
+	while (!stop_requested)
+	{
+		struct timespec slice = {0, STOP_CHECK_NS};
+		struct timespec zero = {0, 0};
+		demi_qresult_t qr;
+		unsigned nbatch = 0;
+		int offset = -1;
+		int ret = 0;
+
+		ret = demi_wait_any(&qr, &offset, ops.qts, ops.n, &slice);
+		if (ret == ETIMEDOUT)
+			continue;
+		assert(ret == 0);
+		server_complete(&ops, offset, &qr, lqd, batch, &nbatch, &stats);
+
+		/* Handle whatever else has completed meanwhile, without waiting. */
+		for (unsigned k = 1; k < batch_size && ops.n > 0; k++)
+		{
+			if (demi_wait_any(&qr, &offset, ops.qts, ops.n, &zero) != 0)
+				break;
+			server_complete(&ops, offset, &qr, lqd, batch, &nbatch, &stats);
+		}
+		stats.batches++;
+
+		/* Echo the batch, then ask for more. */
+		for (unsigned i = 0; i < nbatch; i++)
+		{
+			assert(demi_push(&qt, batch[i].qd, &batch[i].sga) == 0);
+			ops_add(&ops, qt, batch[i].qd, &batch[i].sga);
+		}
+		for (unsigned i = 0; i < nbatch; i++)
+		{
+			assert(demi_pop(&qt, batch[i].qd) == 0);
+			ops_add(&ops, qt, batch[i].qd, NULL);
+		}
+	}
+
+	printf("connections %lu, echoes %lu, bytes %lu, echoes per wake-up %.1f\n", stats.conns, stats.echoes, stats.bytes,
+	       (stats.batches > 0) ? (double)stats.echoes / stats.batches : 0);
+
+	free(ops.qts);
+	free(ops.qds);
+	free(ops.sgas);
+	free(batch);
+}
+
+/*====================================================================================================================*
+ * usage()                                                                                                            *
+ *====================================================================================================================*/
+
+/**
+ * @brief Prints program usage.
+ *
+ * @param progname Program name.
+ */
+static void usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options] ipv4-address port\n", progname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --batch=N                 Largest number of completions handled per wake-up\n");
+	fprintf(stderr, "                            (default: %d).\n", BATCH);
+}
+
+/*====================================================================================================================*
+ * build_sockaddr()                                                                                                   *
+ *====================================================================================================================*/
+
+/**
+ * @brief Builds a socket address.
+ *
+ * @param ip_str    String representation of an IP address.
+ * @param port_str  String representation of a port number.
+ * @param addr      Storage location for socket address.
+ */
+static void build_sockaddr(const char *const ip_str, const char *const port_str, struct sockaddr_in *const addr)
+{
+	int port = -1;
+
+	sscanf(port_str, "%d", &port);
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(port);
+	assert(inet_pton(AF_INET, ip_str, &addr->sin_addr) == 1);
+}
+
+/*====================================================================================================================*
+ * main()                                                                                                             *
+ *====================================================================================================================*/
+
+static const struct option long_options[] = {
+	{"batch", required_argument, NULL, 'b'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0},
+};
+
+int main(int argc, char *const argv[])
+{
+	unsigned batch_size = BATCH;
+	int opt = -1;
+
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'b':
+			sscanf(optarg, "%u", &batch_size);
+			break;
+		default:
+			goto bad_usage;
+		}
+	}
+
+	if (argc - optind == 2 && batch_size > 0)
+	{
+		struct sockaddr_in saddr = {0};
+
+		reg_sighandlers();
+		build_sockaddr(argv[optind], argv[optind + 1], &saddr);
+		server(argc, argv, &saddr, batch_size);
+		return (EXIT_SUCCESS);
+	}
+
+bad_usage:
+	usage(argv[0]);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,104 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "demi/sga.h"
+
+#include "sgapool.h"
+#include "transport.h"
+
+/**
+ * @brief Allocates a scatter-gather array and cooks its data.
+ */
+static demi_sgarray_t sga_cook(size_t data_size)
+{
+	demi_sgarray_t sga = transport->sgaalloc(data_size);
+
+	if (sga.sga_numsegs != 0)
+		memset(sga.sga_segs[0].sgaseg_buf, 0xAB, data_size);
+	return (sga);
+}
+
+/**
+ * @brief Initializes a pool.
+ *
+ * @param pool      Target pool.
+ * @param size      Number of scatter-gather arrays to preallocate, zero to allocate each of them on demand.
+ * @param data_size Number of bytes in each scatter-gather array.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int sga_pool_init(struct sga_pool *pool, unsigned size, size_t data_size)
+{
+	memset(pool, 0, sizeof(struct sga_pool));
+	pool->size = size;
+	pool->data_size = data_size;
+	if (size == 0)
+		return (0);
+
+	pool->free = calloc(size, sizeof(demi_sgarray_t));
+	if (pool->free == NULL)
+		return (-1);
+	for (unsigned i = 0; i < size; i++)
+	{
+		pool->free[i] = sga_cook(data_size);
+		if (pool->free[i].sga_numsegs == 0)
+		{
+			sga_pool_destroy(pool);
+			return (-1);
+		}
+		pool->nfree++;
+	}
+	return (0);
+}
+
+/**
+ * @brief Releases every scatter-gather array held by a pool.
+ *
+ * @param pool Target pool.
+ */
+void sga_pool_destroy(struct sga_pool *pool)
+{
+	while (pool->nfree > 0)
+		assert(transport->sgafree(&pool->free[--pool->nfree]) == 0);
+	free(pool->free);
+	pool->free = NULL;
+}
+
+/**
+ * @brief Takes a filled scatter-gather array from a pool.
+ *
+ * @param pool Target pool.
+ *
+ * @return A scatter-gather array, with no segments if allocation failed.
+ */
+demi_sgarray_t sga_pool_get(struct sga_pool *pool)
+{
+	if (pool->nfree > 0)
+		return (pool->free[--pool->nfree]);
+	if (pool->size > 0)
+		pool->misses++;
+	return (sga_cook(pool->data_size));
+}
+
+/**
+ * @brief Gives a scatter-gather array back to a pool, once it is no longer in use.
+ *
+ * @param pool Target pool.
+ * @param sga  Scatter-gather array to give back.
+ */
+void sga_pool_put(struct sga_pool *pool, demi_sgarray_t *sga)
+{
+	if (pool->nfree < pool->size)
+		pool->free[pool->nfree++] = *sga;
+	else
+		assert(transport->sgafree(sga) == 0);
+}
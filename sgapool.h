@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef SGAPOOL_H_IS_INCLUDED
+#define SGAPOOL_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "demi/types.h"
+
+/**
+ * @brief Pool of preallocated and pre-filled scatter-gather arrays.
+ *
+ * Arrays are handed out most recently released first, so that the one pushed
+ * next is likely to still be in cache. When the pool runs dry, arrays are
+ * allocated on demand, and arrays released to a full pool are freed.
+ */
+struct sga_pool {
+	demi_sgarray_t *free;  /**< Stack of available scatter-gather arrays.   */
+	unsigned nfree;        /**< Number of available scatter-gather arrays.  */
+	unsigned size;         /**< Capacity of the pool.                       */
+	size_t data_size;      /**< Number of bytes in each scatter-gather array. */
+	uint64_t misses;       /**< Number of arrays allocated on demand.       */
+};
+
+/**
+ * @brief Initializes a pool.
+ *
+ * @param pool      Target pool.
+ * @param size      Number of scatter-gather arrays to preallocate, zero to allocate each of them on demand.
+ * @param data_size Number of bytes in each scatter-gather array.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int sga_pool_init(struct sga_pool *pool, unsigned size, size_t data_size);
+
+/**
+ * @brief Releases every scatter-gather array held by a pool.
+ *
+ * @param pool Target pool.
+ */
+void sga_pool_destroy(struct sga_pool *pool);
+
+/**
+ * @brief Takes a filled scatter-gather array from a pool.
+ *
+ * @param pool Target pool.
+ *
+ * @return A scatter-gather array, with no segments if allocation failed.
+ */
+demi_sgarray_t sga_pool_get(struct sga_pool *pool);
+
+/**
+ * @brief Gives a scatter-gather array back to a pool, once it is no longer in use.
+ *
+ * @param pool Target pool.
+ * @param sga  Scatter-gather array to give back.
+ */
+void sga_pool_put(struct sga_pool *pool, demi_sgarray_t *sga);
+
+#endif /* SGAPOOL_H_IS_INCLUDED */
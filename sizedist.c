@@ -0,0 +1,263 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sizedist.h"
+
+/* Largest size drawn from a Pareto distribution when no bound is given. */
+#define PARETO_MAX (1024 * 1024)
+
+/* Largest number of points in an empirical CDF. */
+#define CDF_POINTS SIZE_CLASSES
+
+/* Number of bins a uniform or Pareto distribution is split into. */
+#define SIZE_BINS 256
+
+/**
+ * @brief Empirical cumulative distribution function.
+ */
+struct cdf {
+	unsigned n;                  /**< Number of points.               */
+	size_t sizes[CDF_POINTS];    /**< Sizes, in increasing order.     */
+	double probs[CDF_POINTS];    /**< P(size <= sizes[i]).            */
+};
+
+/**
+ * @brief Loads an empirical CDF from a file.
+ *
+ * Blank lines and lines starting with '#' are skipped. The last probability
+ * is taken to be one.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int cdf_load(struct cdf *cdf, const char *path)
+{
+	char line[256];
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL)
+		return (-1);
+	cdf->n = 0;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		size_t size = 0;
+		double prob = 0;
+
+		if (line[0] == '#' || sscanf(line, "%zu %lf", &size, &prob) != 2)
+			continue;
+		if (cdf->n == CDF_POINTS ||
+		    (cdf->n > 0 && (size <= cdf->sizes[cdf->n - 1] || prob < cdf->probs[cdf->n - 1])))
+		{
+			fclose(fp);
+			return (-1);
+		}
+		cdf->sizes[cdf->n] = size;
+		cdf->probs[cdf->n++] = prob;
+	}
+	fclose(fp);
+	return ((cdf->n > 0) ? 0 : -1);
+}
+
+/**
+ * @brief Appends a size to a distribution under construction.
+ *
+ * A size equal to the last one adds to its probability, and sizes with no
+ * probability are left out.
+ *
+ * @param d    Target distribution.
+ * @param size Size to append, no smaller than the last one.
+ * @param prob Probability of the size.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int size_dist_add(struct size_dist *d, size_t size, double prob)
+{
+	if (!(prob > 0))
+		return (0);
+	if (d->nclasses > 0 && size == d->sizes[d->nclasses - 1])
+	{
+		d->probs[d->nclasses - 1] += prob;
+		return (0);
+	}
+	if (d->nclasses == SIZE_CLASSES || (d->nclasses > 0 && size < d->sizes[d->nclasses - 1]))
+		return (-1);
+	d->sizes[d->nclasses] = size;
+	d->probs[d->nclasses++] = prob;
+	return (0);
+}
+
+/**
+ * @brief Normalizes the probabilities of a distribution and builds its alias table (Vose's method).
+ *
+ * Each of the nclasses slots of the table is drawn with the same odds. Slot
+ * i then keeps size i with odds cutoff[i], and gives size alias[i] otherwise.
+ *
+ * @param d Target distribution.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int size_dist_finish(struct size_dist *d)
+{
+	static uint16_t small[SIZE_CLASSES], large[SIZE_CLASSES];
+	unsigned nsmall = 0, nlarge = 0;
+	double total = 0;
+
+	for (unsigned i = 0; i < d->nclasses; i++)
+		total += d->probs[i];
+	if (d->nclasses == 0 || !(total > 0))
+		return (-1);
+
+	for (unsigned i = 0; i < d->nclasses; i++)
+	{
+		d->probs[i] /= total;
+		d->cutoff[i] = d->probs[i] * d->nclasses;
+		d->alias[i] = i;
+		if (d->cutoff[i] < 1)
+			small[nsmall++] = i;
+		else
+			large[nlarge++] = i;
+	}
+
+	/* Fill the room left in each light slot with part of a heavy one. */
+	while (nsmall > 0 && nlarge > 0)
+	{
+		unsigned s = small[--nsmall], l = large[nlarge - 1];
+
+		d->alias[s] = l;
+		d->cutoff[l] -= 1 - d->cutoff[s];
+		if (d->cutoff[l] < 1)
+		{
+			nlarge--;
+			small[nsmall++] = l;
+		}
+	}
+
+	/* What is left is full, up to rounding errors. */
+	while (nlarge > 0)
+		d->cutoff[large[--nlarge]] = 1;
+	while (nsmall > 0)
+		d->cutoff[small[--nsmall]] = 1;
+	return (0);
+}
+
+/**
+ * @brief Builds a distribution where every message has the same size.
+ *
+ * @param d    Target distribution.
+ * @param size Size of every message.
+ */
+void size_dist_fixed(struct size_dist *d, size_t size)
+{
+	memset(d, 0, sizeof(struct size_dist));
+	size_dist_add(d, size, 1);
+	size_dist_finish(d);
+}
+
+/**
+ * @brief Splits a uniform distribution over [a, b] into at most SIZE_BINS bins of about the same width.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int size_dist_uniform(struct size_dist *d, size_t a, size_t b)
+{
+	double width = (double)(b - a) + 1;
+	unsigned nbins = (width < SIZE_BINS) ? (unsigned)width : SIZE_BINS;
+
+	for (unsigned k = 0; k < nbins; k++)
+	{
+		size_t lo = a + (size_t)(width * k / nbins);
+		size_t hi = a + (size_t)(width * (k + 1) / nbins);
+
+		/* Each bin is drawn as its middle size. */
+		if (size_dist_add(d, lo + (hi - lo - 1) / 2, (hi - lo) / width) != 0)
+			return (-1);
+	}
+	return (0);
+}
+
+/**
+ * @brief Splits a Pareto distribution over [a, b] into SIZE_BINS bins of geometrically increasing width.
+ *
+ * The mass above b, which is drawn as b, gets a class of its own, so that
+ * the tail is kept whatever the bounds.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int size_dist_pareto(struct size_dist *d, size_t a, double alpha, size_t b)
+{
+	double ratio = (double)b / a;
+
+	for (unsigned k = 0; k < SIZE_BINS; k++)
+	{
+		double lo = a * pow(ratio, (double)k / SIZE_BINS);
+		double hi = a * pow(ratio, (double)(k + 1) / SIZE_BINS);
+		double mid = sqrt(lo * hi);
+
+		/* P(lo <= size < hi) = (a / lo)^alpha - (a / hi)^alpha */
+		if (size_dist_add(d, (mid < b) ? (size_t)mid : b, pow(a / lo, alpha) - pow(a / hi, alpha)) != 0)
+			return (-1);
+	}
+	return (size_dist_add(d, b, pow(1 / ratio, alpha)));
+}
+
+/**
+ * @brief Turns an empirical CDF into one class per point.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int size_dist_cdf(struct size_dist *d, const struct cdf *cdf)
+{
+	for (unsigned i = 0; i < cdf->n; i++)
+	{
+		double below = (i > 0) ? cdf->probs[i - 1] : 0;
+		double p = (i + 1 < cdf->n) ? cdf->probs[i] : 1;
+
+		if (size_dist_add(d, cdf->sizes[i], p - below) != 0)
+			return (-1);
+	}
+	return (0);
+}
+
+/**
+ * @brief Builds a distribution from its description.
+ *
+ * Supported descriptions are uniform:MIN-MAX, bimodal:SMALL,LARGE,P (SMALL
+ * with probability P), pareto:MIN,ALPHA[,MAX] and file:PATH, where PATH holds
+ * an empirical CDF as lines of "size cumulative-probability", in increasing
+ * order.
+ *
+ * @param d        Target distribution.
+ * @param spec     Description of the distribution.
+ * @param min_size Smallest acceptable size.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int size_dist_parse(struct size_dist *d, const char *spec, size_t min_size)
+{
+	static struct cdf cdf;
+	size_t a = 0, b = 0;
+	double x = 0;
+	int ret = -1;
+
+	memset(d, 0, sizeof(struct size_dist));
+	if (sscanf(spec, "uniform:%zu-%zu", &a, &b) == 2 && a <= b)
+		ret = size_dist_uniform(d, a, b);
+	else if (sscanf(spec, "bimodal:%zu,%zu,%lf", &a, &b, &x) == 3 && x >= 0 && x <= 1)
+		ret = (size_dist_add(d, a, x) == 0 && size_dist_add(d, b, 1 - x) == 0) ? 0 : -1;
+	else if (sscanf(spec, "pareto:%zu,%lf", &a, &x) == 2 && x > 0 && a > 0)
+	{
+		if (sscanf(spec, "pareto:%zu,%lf,%zu", &a, &x, &b) != 3)
+			b = PARETO_MAX;
+		if (a <= b)
+			ret = size_dist_pareto(d, a, x, b);
+	}
+	else if (strncmp(spec, "file:", 5) == 0 && cdf_load(&cdf, spec + 5) == 0)
+		ret = size_dist_cdf(d, &cdf);
+
+	if (ret != 0 || size_dist_finish(d) != 0 || d->sizes[0] < min_size)
+		return (-1);
+	return (0);
+}
@@ -0,0 +1,87 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef SIZEDIST_H_IS_INCLUDED
+#define SIZEDIST_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Largest number of distinct sizes in a distribution.
+ */
+#define SIZE_CLASSES 4096
+
+/**
+ * @brief Number of power-of-two buckets message sizes are grouped in for reporting.
+ */
+#define SIZE_BUCKETS 64
+
+/**
+ * @brief Distribution of message sizes.
+ *
+ * The distribution is reduced to at most SIZE_CLASSES distinct sizes, each
+ * with the probability mass the distribution gives it, so that every size
+ * that can be drawn is known in advance. Continuous distributions are split
+ * into bins, each drawn as one size. Sizes are drawn from an alias table,
+ * with one lookup and one comparison, however unlikely some of them are.
+ */
+struct size_dist {
+	unsigned nclasses;              /**< Number of distinct sizes.                        */
+	size_t sizes[SIZE_CLASSES];     /**< Distinct sizes, in increasing order.             */
+	double probs[SIZE_CLASSES];     /**< Probability of each size.                        */
+	double cutoff[SIZE_CLASSES];    /**< Alias table: odds of keeping a slot's own size.  */
+	uint16_t alias[SIZE_CLASSES];   /**< Alias table: size drawn otherwise.               */
+};
+
+/**
+ * @brief Builds a distribution where every message has the same size.
+ *
+ * @param d    Target distribution.
+ * @param size Size of every message.
+ */
+void size_dist_fixed(struct size_dist *d, size_t size);
+
+/**
+ * @brief Builds a distribution from its description.
+ *
+ * Supported descriptions are uniform:MIN-MAX, bimodal:SMALL,LARGE,P (SMALL
+ * with probability P), pareto:MIN,ALPHA[,MAX] and file:PATH, where PATH holds
+ * an empirical CDF as lines of "size cumulative-probability", in increasing
+ * order.
+ *
+ * @param d        Target distribution.
+ * @param spec     Description of the distribution.
+ * @param min_size Smallest acceptable size.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int size_dist_parse(struct size_dist *d, const char *spec, size_t min_size);
+
+/**
+ * @brief Draws the size class of a message.
+ *
+ * @param d Target distribution.
+ * @param u Uniformly distributed number in (0, 1].
+ *
+ * @return Size class of the message.
+ */
+static inline unsigned size_dist_draw(const struct size_dist *d, double u)
+{
+	double x = u * d->nclasses;
+	unsigned i = (unsigned)x;
+
+	if (i >= d->nclasses)
+		i = d->nclasses - 1;
+	return ((x - i < d->cutoff[i]) ? i : d->alias[i]);
+}
+
+/**
+ * @brief Returns the power-of-two bucket of a size, that is the smallest b such that size <= 2^b.
+ */
+static inline unsigned size_bucket(size_t size)
+{
+	return ((size <= 1) ? 0 : 64 - __builtin_clzll(size - 1));
+}
+
+#endif /* SIZEDIST_H_IS_INCLUDED */
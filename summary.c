@@ -0,0 +1,256 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "summary.h"
+
+/**
+ * @brief Appends a field to a record.
+ *
+ * The value is copied whatever its length, so that long paths are kept whole.
+ *
+ * @return The new field, with its key and value set.
+ */
+static struct summary_field *summary_field(struct summary_rec *r, const char *key, const char *value)
+{
+	struct summary_field *f = NULL;
+
+	assert(r->n < SUMMARY_FIELDS && strlen(key) < sizeof(f->key));
+	f = &r->fields[r->n++];
+	memset(f, 0, sizeof(struct summary_field));
+	strcpy(f->key, key);
+	f->value = strdup(value);
+	assert(f->value != NULL);
+	return (f);
+}
+
+/**
+ * @brief Releases the values of a record.
+ */
+static void summary_rec_destroy(struct summary_rec *r)
+{
+	for (unsigned i = 0; i < r->n; i++)
+		free(r->fields[i].value);
+	r->n = 0;
+}
+
+/**
+ * @brief Prints a string as a JSON string.
+ */
+static void json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (const char *p = str; *p != '\0'; p++)
+	{
+		if (*p == '"' || *p == '\\')
+			fprintf(fp, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char)*p);
+		else
+			fputc(*p, fp);
+	}
+	fputc('"', fp);
+}
+
+/**
+ * @brief Prints a record as a JSON object.
+ */
+static void json_rec(FILE *fp, const struct summary_rec *r, const char *indent)
+{
+	fprintf(fp, "{");
+	for (unsigned i = 0; i < r->n; i++)
+	{
+		const struct summary_field *f = &r->fields[i];
+
+		fprintf(fp, "%s\n%s  ", (i > 0) ? "," : "", indent);
+		json_string(fp, f->key);
+		fprintf(fp, ": ");
+		if (f->null)
+			fprintf(fp, "null");
+		else if (f->quoted)
+			json_string(fp, f->value);
+		else
+			fprintf(fp, "%s", f->value);
+	}
+	fprintf(fp, "\n%s}", indent);
+}
+
+/**
+ * @brief Prints a string as a CSV field, quoted if needed.
+ */
+static void csv_field(FILE *fp, const char *str)
+{
+	if (strpbrk(str, ",\"\r\n") == NULL)
+	{
+		fprintf(fp, "%s", str);
+		return;
+	}
+	fputc('"', fp);
+	for (const char *p = str; *p != '\0'; p++)
+	{
+		if (*p == '"')
+			fputc('"', fp);
+		fputc(*p, fp);
+	}
+	fputc('"', fp);
+}
+
+/**
+ * @brief Prints the keys or the values of a record as CSV fields.
+ *
+ * @param fp    Target stream.
+ * @param r     Target record.
+ * @param keys  Whether to print keys rather than values.
+ * @param first Whether the fields start the row.
+ */
+static void csv_rec(FILE *fp, const struct summary_rec *r, int keys, int first)
+{
+	for (unsigned i = 0; i < r->n; i++)
+	{
+		if (!first || i > 0)
+			fputc(',', fp);
+		csv_field(fp, keys ? r->fields[i].key : r->fields[i].value);
+	}
+}
+
+/**
+ * @brief Initializes an empty summary.
+ *
+ * @param s Target summary.
+ */
+void summary_init(struct summary *s)
+{
+	memset(s, 0, sizeof(struct summary));
+}
+
+/**
+ * @brief Releases the memory of a summary.
+ *
+ * @param s Target summary.
+ */
+void summary_destroy(struct summary *s)
+{
+	summary_rec_destroy(&s->config);
+	summary_rec_destroy(&s->calibration);
+	for (size_t i = 0; i < s->nruns; i++)
+		summary_rec_destroy(&s->runs[i]);
+	free(s->runs);
+	memset(s, 0, sizeof(struct summary));
+}
+
+/**
+ * @brief Appends an empty record for the results of a run.
+ *
+ * @param s Target summary.
+ *
+ * @return The new record.
+ */
+struct summary_rec *summary_add_run(struct summary *s)
+{
+	struct summary_rec *runs = realloc(s->runs, (s->nruns + 1) * sizeof(struct summary_rec));
+
+	assert(runs != NULL);
+	s->runs = runs;
+	memset(&s->runs[s->nruns], 0, sizeof(struct summary_rec));
+	return (&s->runs[s->nruns++]);
+}
+
+/**
+ * @brief Appends a string field to a record.
+ *
+ * @param r     Target record.
+ * @param key   Name of the field.
+ * @param value Value of the field, NULL if missing.
+ */
+void summary_str(struct summary_rec *r, const char *key, const char *value)
+{
+	struct summary_field *f = summary_field(r, key, (value != NULL) ? value : "");
+
+	f->quoted = 1;
+	f->null = (value == NULL);
+}
+
+/**
+ * @brief Appends an integer field to a record.
+ *
+ * @param r     Target record.
+ * @param key   Name of the field.
+ * @param value Value of the field.
+ */
+void summary_uint(struct summary_rec *r, const char *key, uint64_t value)
+{
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), "%lu", value);
+	summary_field(r, key, buf);
+}
+
+/**
+ * @brief Appends a real field to a record.
+ *
+ * @param r     Target record.
+ * @param key   Name of the field.
+ * @param value Value of the field.
+ */
+void summary_real(struct summary_rec *r, const char *key, double value)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%.6g", value);
+	summary_field(r, key, buf);
+}
+
+/**
+ * @brief Writes a summary as a JSON object with members "config", "calibration" and "runs".
+ *
+ * @param s  Target summary.
+ * @param fp Target stream.
+ */
+void summary_write_json(const struct summary *s, FILE *fp)
+{
+	fprintf(fp, "{\n  \"config\": ");
+	json_rec(fp, &s->config, "  ");
+	fprintf(fp, ",\n  \"calibration\": ");
+	json_rec(fp, &s->calibration, "  ");
+	fprintf(fp, ",\n  \"runs\": [");
+	for (size_t i = 0; i < s->nruns; i++)
+	{
+		fprintf(fp, "%s\n    ", (i > 0) ? "," : "");
+		json_rec(fp, &s->runs[i], "    ");
+	}
+	fprintf(fp, "%s]\n}\n", (s->nruns > 0) ? "\n  " : "");
+}
+
+/**
+ * @brief Writes a summary as CSV, one row per run, with the run parameters and calibration in every row.
+ *
+ * Runs are expected to have the same fields, so that the header of the first one fits them all.
+ *
+ * @param s  Target summary.
+ * @param fp Target stream.
+ */
+void summary_write_csv(const struct summary *s, FILE *fp)
+{
+	for (size_t i = 0; i < s->nruns; i++)
+	{
+		if (i == 0)
+		{
+			csv_rec(fp, &s->config, 1, 1);
+			csv_rec(fp, &s->calibration, 1, s->config.n == 0);
+			csv_rec(fp, &s->runs[0], 1, s->config.n + s->calibration.n == 0);
+			fputc('\n', fp);
+		}
+		csv_rec(fp, &s->config, 0, 1);
+		csv_rec(fp, &s->calibration, 0, s->config.n == 0);
+		csv_rec(fp, &s->runs[i], 0, s->config.n + s->calibration.n == 0);
+		fputc('\n', fp);
+	}
+}
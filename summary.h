@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef SUMMARY_H_IS_INCLUDED
+#define SUMMARY_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Largest number of fields in a summary record.
+ */
+#define SUMMARY_FIELDS 48
+
+/**
+ * @brief A named value of a summary record.
+ */
+struct summary_field {
+	char key[32];   /**< Name of the field.                         */
+	char *value;    /**< Value of the field, as printed.            */
+	int quoted;     /**< Whether the value is a string.             */
+	int null;       /**< Whether the value is missing.              */
+};
+
+/**
+ * @brief An ordered set of fields: the run parameters, the calibration, or the results of a run.
+ */
+struct summary_rec {
+	struct summary_field fields[SUMMARY_FIELDS]; /**< Fields, in insertion order. */
+	unsigned n;                                  /**< Number of fields.           */
+};
+
+/**
+ * @brief Machine-readable results of a client invocation.
+ */
+struct summary {
+	struct summary_rec config;      /**< Run parameters.                 */
+	struct summary_rec calibration; /**< Clock calibration.              */
+	struct summary_rec *runs;       /**< Results of each run, in order.  */
+	size_t nruns;                   /**< Number of runs.                 */
+};
+
+/**
+ * @brief Initializes an empty summary.
+ *
+ * @param s Target summary.
+ */
+void summary_init(struct summary *s);
+
+/**
+ * @brief Releases the memory of a summary.
+ *
+ * @param s Target summary.
+ */
+void summary_destroy(struct summary *s);
+
+/**
+ * @brief Appends an empty record for the results of a run.
+ *
+ * @param s Target summary.
+ *
+ * @return The new record.
+ */
+struct summary_rec *summary_add_run(struct summary *s);
+
+/**
+ * @brief Appends a string field to a record.
+ *
+ * @param r     Target record.
+ * @param key   Name of the field.
+ * @param value Value of the field, NULL if missing.
+ */
+void summary_str(struct summary_rec *r, const char *key, const char *value);
+
+/**
+ * @brief Appends an integer field to a record.
+ *
+ * @param r     Target record.
+ * @param key   Name of the field.
+ * @param value Value of the field.
+ */
+void summary_uint(struct summary_rec *r, const char *key, uint64_t value);
+
+/**
+ * @brief Appends a real field to a record.
+ *
+ * @param r     Target record.
+ * @param key   Name of the field.
+ * @param value Value of the field.
+ */
+void summary_real(struct summary_rec *r, const char *key, double value);
+
+/**
+ * @brief Writes a summary as a JSON object with members "config", "calibration" and "runs".
+ *
+ * @param s  Target summary.
+ * @param fp Target stream.
+ */
+void summary_write_json(const struct summary *s, FILE *fp);
+
+/**
+ * @brief Writes a summary as CSV, one row per run, with the run parameters and calibration in every row.
+ *
+ * @param s  Target summary.
+ * @param fp Target stream.
+ */
+void summary_write_csv(const struct summary *s, FILE *fp);
+
+#endif /* SUMMARY_H_IS_INCLUDED */
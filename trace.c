@@ -0,0 +1,313 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+/* Size of the header that precedes the payload in every message. */
+#define TRACE_HDR_SIZE 16
+
+/**
+ * @brief Finds the value of a member in a JSON object on a single line.
+ *
+ * @return The first character of the value, or NULL if there is no such member.
+ */
+static const char *json_member(const char *line, const char *name)
+{
+	size_t len = strlen(name);
+
+	for (const char *p = strchr(line, '"'); p != NULL; p = strchr(p + 1, '"'))
+	{
+		if (strncmp(p + 1, name, len) != 0 || p[len + 1] != '"')
+			continue;
+		p += len + 2;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p++ != ':')
+			continue;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		return (p);
+	}
+	return (NULL);
+}
+
+/**
+ * @brief Returns the value of a hexadecimal digit, or -1 if it is not one.
+ */
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return (c - '0');
+	if (c >= 'a' && c <= 'f')
+		return (c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return (c - 'A' + 10);
+	return (-1);
+}
+
+/**
+ * @brief Appends a hex-encoded payload to the payload area of a trace.
+ *
+ * @param t   Target trace.
+ * @param hex Payload, right after its opening quote.
+ * @param rec Request the payload belongs to.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int trace_add_payload(struct trace *t, const char *hex, struct trace_rec *rec)
+{
+	const char *end = strchr(hex, '"');
+	size_t len = 0;
+	uint8_t *area = NULL;
+
+	if (end == NULL || (end - hex) % 2 != 0)
+		return (-1);
+	len = (end - hex) / 2;
+	if (len > rec->size - TRACE_HDR_SIZE)
+		len = rec->size - TRACE_HDR_SIZE;
+
+	area = realloc(t->payloads, t->payloads_len + len);
+	if (area == NULL && len > 0)
+		return (-1);
+	t->payloads = area;
+	for (size_t i = 0; i < len; i++)
+	{
+		int hi = hex_digit(hex[2 * i]), lo = hex_digit(hex[2 * i + 1]);
+
+		if (hi < 0 || lo < 0)
+			return (-1);
+		t->payloads[t->payloads_len + i] = (uint8_t)(hi << 4 | lo);
+	}
+	rec->payload = t->payloads_len;
+	rec->payload_len = len;
+	t->payloads_len += len;
+	return (0);
+}
+
+/**
+ * @brief Send time of a request and its position in the capture, for sorting.
+ */
+struct trace_key {
+	uint64_t offset; /**< Send time.                            */
+	size_t index;    /**< Position of the request in the file.  */
+};
+
+/**
+ * @brief Compares requests by send time, then by position in the capture.
+ */
+static int trace_key_cmp(const void *a, const void *b)
+{
+	const struct trace_key *x = a, *y = b;
+
+	if (x->offset != y->offset)
+		return ((x->offset < y->offset) ? -1 : 1);
+	return ((x->index < y->index) ? -1 : (x->index > y->index));
+}
+
+/**
+ * @brief Orders requests by send time.
+ *
+ * Requests sent at the same time keep the order of the capture, which is
+ * already sorted more often than not.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int trace_sort(struct trace *t)
+{
+	struct trace_key *keys = NULL;
+	struct trace_rec *recs = NULL;
+	size_t i = 1;
+
+	while (i < t->n && t->recs[i - 1].offset <= t->recs[i].offset)
+		i++;
+	if (i >= t->n)
+		return (0);
+
+	keys = malloc(t->n * sizeof(struct trace_key));
+	recs = malloc(t->n * sizeof(struct trace_rec));
+	if (keys == NULL || recs == NULL)
+	{
+		free(keys);
+		free(recs);
+		return (-1);
+	}
+	for (i = 0; i < t->n; i++)
+		keys[i] = (struct trace_key){t->recs[i].offset, i};
+	qsort(keys, t->n, sizeof(struct trace_key), trace_key_cmp);
+	for (i = 0; i < t->n; i++)
+		recs[i] = t->recs[keys[i].index];
+	free(keys);
+	free(t->recs);
+	t->recs = recs;
+	return (0);
+}
+
+/**
+ * @brief Parses a send time in microseconds into nanoseconds.
+ *
+ * The integer and fractional parts are parsed apart, so that epoch
+ * timestamps keep their sub-microsecond digits, which a double cannot hold
+ * once scaled to nanoseconds.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+static int trace_parse_ts(const char *ts, uint64_t *ns)
+{
+	char *end = NULL;
+	uint64_t us = 0, frac = 0;
+	unsigned digits = 0;
+
+	if (*ts < '0' || *ts > '9')
+		return (-1);
+	us = strtoull(ts, &end, 10);
+	if (*end == '.')
+	{
+		for (end++; *end >= '0' && *end <= '9'; end++)
+		{
+			if (digits < 3)
+			{
+				frac = frac * 10 + (uint64_t)(*end - '0');
+				digits++;
+			}
+		}
+	}
+	if (*end == 'e' || *end == 'E')
+	{
+		*ns = (uint64_t)(strtod(ts, NULL) * 1000);
+		return (0);
+	}
+	for (; digits < 3; digits++)
+		frac *= 10;
+	*ns = us * 1000 + frac;
+	return (0);
+}
+
+/**
+ * @brief Groups request sizes in power-of-two buffer classes.
+ */
+static void trace_classify(struct trace *t)
+{
+	size_t counts[SIZE_BUCKETS] = {0};
+	int class_of[SIZE_BUCKETS];
+
+	for (size_t i = 0; i < t->n; i++)
+		counts[size_bucket(t->recs[i].size)]++;
+
+	memset(&t->dist, 0, sizeof(struct size_dist));
+	for (unsigned b = 0; b < SIZE_BUCKETS; b++)
+	{
+		class_of[b] = -1;
+		if (counts[b] == 0)
+			continue;
+		class_of[b] = t->dist.nclasses;
+		t->dist.sizes[t->dist.nclasses] = (size_t)1 << b;
+		t->dist.probs[t->dist.nclasses++] = (double)counts[b] / t->n;
+	}
+
+	for (size_t i = 0; i < t->n; i++)
+		t->recs[i].class = class_of[size_bucket(t->recs[i].size)];
+}
+
+/**
+ * @brief Loads a trace from a JSONL file.
+ *
+ * Each line is an object with members "ts" (send time in microseconds),
+ * "conn", "size" and optionally "payload" (hex string, copied after the
+ * message header).
+ *
+ * @param t        Target trace.
+ * @param path     Path to the trace file.
+ * @param min_size Smallest acceptable request size.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int trace_load(struct trace *t, const char *path, size_t min_size)
+{
+	FILE *fp = fopen(path, "r");
+	char *line = NULL;
+	size_t cap = 0, capacity = 0;
+
+	memset(t, 0, sizeof(struct trace));
+	if (fp == NULL)
+		return (-1);
+
+	while (getline(&line, &cap, fp) != -1)
+	{
+		const char *ts = json_member(line, "ts");
+		const char *conn = json_member(line, "conn");
+		const char *size = json_member(line, "size");
+		const char *payload = json_member(line, "payload");
+		struct trace_rec *rec = NULL;
+
+		if (ts == NULL && conn == NULL && size == NULL)
+			continue;
+		if (ts == NULL || conn == NULL || size == NULL)
+			goto fail;
+
+		if (t->n == capacity)
+		{
+			struct trace_rec *recs = NULL;
+
+			capacity = (capacity > 0) ? 2 * capacity : 1024;
+			recs = realloc(t->recs, capacity * sizeof(struct trace_rec));
+			if (recs == NULL)
+				goto fail;
+			t->recs = recs;
+		}
+		rec = &t->recs[t->n];
+		memset(rec, 0, sizeof(struct trace_rec));
+
+		rec->conn = strtoul(conn, NULL, 10);
+		rec->size = strtoul(size, NULL, 10);
+		if (trace_parse_ts(ts, &rec->offset) != 0 || rec->size < min_size || rec->size < TRACE_HDR_SIZE)
+			goto fail;
+		if (payload != NULL && *payload == '"' && trace_add_payload(t, payload + 1, rec) != 0)
+			goto fail;
+		t->n++;
+	}
+	free(line);
+	fclose(fp);
+	if (t->n == 0)
+	{
+		trace_destroy(t);
+		return (-1);
+	}
+
+	/* Make times relative to the earliest request. */
+	if (trace_sort(t) != 0)
+	{
+		trace_destroy(t);
+		return (-1);
+	}
+	for (size_t i = t->n; i-- > 0;)
+		t->recs[i].offset -= t->recs[0].offset;
+	trace_classify(t);
+	return (0);
+
+fail:
+	free(line);
+	fclose(fp);
+	trace_destroy(t);
+	return (-1);
+}
+
+/**
+ * @brief Releases a trace.
+ *
+ * @param t Target trace.
+ */
+void trace_destroy(struct trace *t)
+{
+	free(t->recs);
+	free(t->payloads);
+	memset(t, 0, sizeof(struct trace));
+}
@@ -0,0 +1,60 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef TRACE_H_IS_INCLUDED
+#define TRACE_H_IS_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sizedist.h"
+
+/**
+ * @brief A request of a trace, parsed.
+ */
+struct trace_rec {
+	uint64_t offset;      /**< Send time in nanoseconds from the first request. */
+	uint32_t conn;        /**< Connection the request was sent on.             */
+	uint32_t size;        /**< Number of bytes in the request.                  */
+	uint32_t payload;     /**< Offset of the payload in the payload area.       */
+	uint32_t payload_len; /**< Number of bytes of payload, zero for none.       */
+	uint8_t class;        /**< Buffer size class of the request.                */
+};
+
+/**
+ * @brief A captured sequence of requests, parsed ahead of a replay.
+ *
+ * Requests are kept in send order. Buffers are grouped in power-of-two size
+ * classes, so that a trace with many distinct sizes needs few pools.
+ */
+struct trace {
+	struct trace_rec *recs; /**< Requests, in send order.                  */
+	size_t n;               /**< Number of requests.                       */
+	uint8_t *payloads;      /**< Payloads of all requests, back to back.   */
+	size_t payloads_len;    /**< Number of bytes in the payload area.      */
+	struct size_dist dist;  /**< Buffer size classes and their frequency.  */
+};
+
+/**
+ * @brief Loads a trace from a JSONL file.
+ *
+ * Each line is an object with members "ts" (send time in microseconds),
+ * "conn", "size" and optionally "payload" (hex string, copied after the
+ * message header).
+ *
+ * @param t        Target trace.
+ * @param path     Path to the trace file.
+ * @param min_size Smallest acceptable request size.
+ *
+ * @return On success, zero is returned. On failure, -1 is returned instead.
+ */
+int trace_load(struct trace *t, const char *path, size_t min_size);
+
+/**
+ * @brief Releases a trace.
+ *
+ * @param t Target trace.
+ */
+void trace_destroy(struct trace *t);
+
+#endif /* TRACE_H_IS_INCLUDED */
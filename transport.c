@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+
+#include "transport.h"
+
+/**
+ * @brief Demikernel, through libdemikernel.
+ */
+const struct transport transport_demikernel = {
+	.name = "demikernel",
+	.init = demi_init,
+	.socket = demi_socket,
+	.bind = demi_bind,
+	.listen = demi_listen,
+	.accept = demi_accept,
+	.connect = demi_connect,
+	.close = demi_close,
+	.push = demi_push,
+	.pop = demi_pop,
+	.wait_any = demi_wait_any,
+	.sgaalloc = demi_sgaalloc,
+	.sgafree = demi_sgafree,
+};
+
+/**
+ * @brief Backend in use, Demikernel unless another one is picked at startup.
+ */
+const struct transport *transport = &transport_demikernel;
+
+/**
+ * @brief Finds a backend by name.
+ *
+ * @param name Name of the backend.
+ *
+ * @return The backend, or NULL if there is no such backend.
+ */
+const struct transport *transport_find(const char *name)
+{
+	static const struct transport *const all[] = {&transport_demikernel, &transport_kernel, &transport_uring};
+
+	for (unsigned i = 0; i < sizeof(all) / sizeof(all[0]); i++)
+	{
+		if (strcmp(all[i]->name, name) == 0)
+			return (all[i]);
+	}
+	return (NULL);
+}
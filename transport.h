@@ -0,0 +1,79 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef TRANSPORT_H_IS_INCLUDED
+#define TRANSPORT_H_IS_INCLUDED
+
+#include <time.h>
+
+#include "demi/libos.h"
+#include "demi/sga.h"
+#include "demi/wait.h"
+
+/**
+ * @brief A network stack with the Demikernel queue API.
+ *
+ * Every backend has the semantics of the Demikernel calls it stands for, so
+ * the same workload is issued and measured the same way over any of them.
+ * Queue descriptors and tokens of a backend only mean something to it.
+ */
+struct transport {
+	const char *name; /**< Name of the backend, as given on the command line. */
+	int (*init)(int argc, char *const argv[]);
+	int (*socket)(int *sockqd_out, int domain, int type, int protocol);
+	int (*bind)(int sockqd, const struct sockaddr *addr, socklen_t size);
+	int (*listen)(int sockqd, int backlog);
+	int (*accept)(demi_qtoken_t *qt_out, int sockqd);
+	int (*connect)(demi_qtoken_t *qt_out, int sockqd, const struct sockaddr *addr, socklen_t size);
+	int (*close)(int qd);
+	int (*push)(demi_qtoken_t *qt_out, int qd, const demi_sgarray_t *sga);
+	int (*pop)(demi_qtoken_t *qt_out, int qd);
+	int (*wait_any)(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts,
+			const struct timespec *timeout);
+	demi_sgarray_t (*sgaalloc)(size_t size);
+	int (*sgafree)(demi_sgarray_t *sga);
+	void (*fini)(void); /**< Releases what init set up, once no other thread uses the backend. NULL if none. */
+};
+
+/**
+ * @brief Demikernel, through libdemikernel.
+ */
+extern const struct transport transport_demikernel;
+
+/**
+ * @brief Linux kernel sockets, non-blocking and watched with epoll.
+ */
+extern const struct transport transport_kernel;
+
+/**
+ * @brief io_uring, with fixed files and registered buffers.
+ */
+extern const struct transport transport_uring;
+
+/**
+ * @brief Whether io_uring rings are polled by a kernel thread (SQPOLL), to be set before they are set up.
+ */
+extern int uring_sqpoll;
+
+/**
+ * @brief Checks whether the io_uring ring of the calling thread uses registered buffers.
+ *
+ * @return Non-zero if it does, zero if registering them failed, for instance over RLIMIT_MEMLOCK.
+ */
+int uring_fixed_buffers(void);
+
+/**
+ * @brief Backend in use, Demikernel unless another one is picked at startup.
+ */
+extern const struct transport *transport;
+
+/**
+ * @brief Finds a backend by name.
+ *
+ * @param name Name of the backend.
+ *
+ * @return The backend, or NULL if there is no such backend.
+ */
+const struct transport *transport_find(const char *name);
+
+#endif /* TRANSPORT_H_IS_INCLUDED */
@@ -0,0 +1,166 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+/* This should come first. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <cpuid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tsc.h"
+
+/* How long each round of frequency calibration lasts. */
+#define TSC_CALIBRATION_NS (50 * 1000 * 1000)
+
+/* Number of rounds of frequency calibration, the median is kept. */
+#define TSC_CALIBRATION_ROUNDS 5
+
+/* Number of back-to-back readings used to measure the cost of read_tsc(). */
+#define TSC_OVERHEAD_ROUNDS 100000
+
+static uint64_t hz = 0;
+static uint64_t overhead = 0;
+static int invariant = 0;
+
+/**
+ * @brief Returns the current time of a clock in nanoseconds.
+ */
+static uint64_t clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+
+/**
+ * @brief Compares two frequencies, for qsort().
+ */
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return ((x > y) - (x < y));
+}
+
+/**
+ * @brief Measures the frequency of the time-stamp counter over a short sleep.
+ */
+static uint64_t measure_hz(void)
+{
+	const struct timespec pause = {0, TSC_CALIBRATION_NS};
+	uint64_t t0, t1, c0, c1;
+
+	t0 = clock_ns(CLOCK_MONOTONIC_RAW);
+	c0 = read_tsc();
+	nanosleep(&pause, NULL);
+	t1 = clock_ns(CLOCK_MONOTONIC_RAW);
+	c1 = read_tsc();
+
+	return ((uint64_t)((double)(c1 - c0) * 1e9 / (double)(t1 - t0)));
+}
+
+/**
+ * @brief Measures the smallest number of ticks between two back-to-back calls to read_tsc().
+ */
+static uint64_t measure_overhead(void)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (unsigned i = 0; i < TSC_OVERHEAD_ROUNDS; i++)
+	{
+		uint64_t before = read_tsc();
+		uint64_t after = read_tsc();
+
+		if (after - before < best)
+			best = after - before;
+	}
+	return (best);
+}
+
+/**
+ * @brief Checks CPUID for an invariant time-stamp counter.
+ */
+static int check_invariant(void)
+{
+	unsigned eax, ebx, ecx, edx;
+
+	/* Advanced power management leaf, bit 8 of EDX. */
+	if (__get_cpuid_max(0x80000000, NULL) < 0x80000007)
+		return (0);
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return (0);
+	return ((edx >> 8) & 1);
+}
+
+/**
+ * @brief Calibrates the time-stamp counter.
+ *
+ * Measures the frequency of the time-stamp counter against CLOCK_MONOTONIC_RAW
+ * and the cost of read_tsc() itself, and checks whether the CPU advertises an
+ * invariant time-stamp counter. Results are printed on stderr.
+ */
+void tsc_calibrate(void)
+{
+	uint64_t rounds[TSC_CALIBRATION_ROUNDS];
+
+	invariant = check_invariant();
+	if (!invariant)
+		fprintf(stderr, "warning: TSC is not invariant, latencies may be wrong if the CPU changes frequency\n");
+
+	for (unsigned i = 0; i < TSC_CALIBRATION_ROUNDS; i++)
+		rounds[i] = measure_hz();
+	qsort(rounds, TSC_CALIBRATION_ROUNDS, sizeof(uint64_t), cmp_u64);
+	hz = rounds[TSC_CALIBRATION_ROUNDS / 2];
+
+	overhead = measure_overhead();
+
+	fprintf(stderr, "TSC: %.3f MHz (spread %.3f MHz), read overhead %lu ticks, invariant: %s\n", hz / 1e6,
+		(rounds[TSC_CALIBRATION_ROUNDS - 1] - rounds[0]) / 1e6, overhead, invariant ? "yes" : "no");
+}
+
+/**
+ * @brief Returns the frequency of the time-stamp counter, calibrating it first if needed.
+ *
+ * @return Number of time-stamp counter ticks per second.
+ */
+uint64_t tsc_hz(void)
+{
+	if (hz == 0)
+		tsc_calibrate();
+	return (hz);
+}
+
+/**
+ * @brief Returns the number of ticks spent by read_tsc() itself.
+ */
+uint64_t tsc_overhead(void)
+{
+	return (overhead);
+}
+
+/**
+ * @brief Checks whether the time-stamp counter ticks at a constant rate, even in deep C-states.
+ *
+ * @return Non-zero if the CPU advertises an invariant time-stamp counter, zero otherwise.
+ */
+int tsc_invariant(void)
+{
+	return (invariant);
+}
+
+/**
+ * @brief Converts an interval measured with two calls to read_tsc() into nanoseconds.
+ *
+ * @param ticks Number of ticks between the two readings.
+ *
+ * @return Length of the interval in nanoseconds, minus the cost of read_tsc().
+ */
+uint64_t tsc_to_ns(uint64_t ticks)
+{
+	ticks = (ticks > overhead) ? ticks - overhead : 0;
+	return ((uint64_t)((double)ticks * 1e9 / (double)tsc_hz()));
+}
@@ -0,0 +1,60 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef TSC_H_IS_INCLUDED
+#define TSC_H_IS_INCLUDED
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+/**
+ * @brief Reads the time-stamp counter.
+ *
+ * @return Current value of the time-stamp counter.
+ */
+static inline
+uint64_t read_tsc(void) {
+	_mm_lfence();  // optionally wait for earlier insns to retire before reading the clock
+	uint64_t tsc = __rdtsc();
+	_mm_lfence();  // optionally block later instructions until rdtsc retires
+	return tsc;
+}
+
+/**
+ * @brief Calibrates the time-stamp counter.
+ *
+ * Measures the frequency of the time-stamp counter against CLOCK_MONOTONIC_RAW
+ * and the cost of read_tsc() itself, and checks whether the CPU advertises an
+ * invariant time-stamp counter. Results are printed on stderr.
+ */
+void tsc_calibrate(void);
+
+/**
+ * @brief Returns the frequency of the time-stamp counter, calibrating it first if needed.
+ *
+ * @return Number of time-stamp counter ticks per second.
+ */
+uint64_t tsc_hz(void);
+
+/**
+ * @brief Returns the number of ticks spent by read_tsc() itself.
+ */
+uint64_t tsc_overhead(void);
+
+/**
+ * @brief Checks whether the time-stamp counter ticks at a constant rate, even in deep C-states.
+ *
+ * @return Non-zero if the CPU advertises an invariant time-stamp counter, zero otherwise.
+ */
+int tsc_invariant(void);
+
+/**
+ * @brief Converts an interval measured with two calls to read_tsc() into nanoseconds.
+ *
+ * @param ticks Number of ticks between the two readings.
+ *
+ * @return Length of the interval in nanoseconds, minus the cost of read_tsc().
+ */
+uint64_t tsc_to_ns(uint64_t ticks);
+
+#endif /* TSC_H_IS_INCLUDED */
@@ -0,0 +1,1136 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+/*
+ * Demikernel queue API on top of io_uring.
+ *
+ * Every thread gets a ring of its own, set up the first time it opens a
+ * socket. Sockets are installed in the fixed file table of the ring, and
+ * buffers come from one arena registered with every ring, so pushes and pops
+ * are issued as WRITE_FIXED/READ_FIXED and skip both the file table lookup
+ * and the page pinning of each request. Buffers that do not fit in the arena
+ * fall back to plain SEND/RECV.
+ *
+ * A queue has at most one push and one pop or accept in flight, so that
+ * operations on it complete in the order in which they were issued, as with
+ * Demikernel. Requests are only handed to the kernel when waiting, so the
+ * pushes issued between two waits go out in a single system call. With
+ * SQPOLL a kernel thread picks them up instead, and waiting without blocking
+ * costs no system call at all.
+ *
+ * Tokens are indices in a table of the calling thread: an operation must be
+ * waited for by the thread that issued it. A ring is torn down when its
+ * thread exits, and the arena when the backend is shut down.
+ */
+
+// This should come first.
+// Glibc macro to expose definitions corresponding to the POSIX.1-2008 base specification.
+// See https://man7.org/linux/man-pages/man7/feature_test_macros.7.html.
+#define _POSIX_C_SOURCE 200809L
+// Needed for syscall().
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "transport.h"
+
+/* Submission queue entries per ring, and completion queue entries per submission queue entry. */
+#define URING_ENTRIES 1024
+#define URING_CQ_RATIO 4
+
+/* Slots in the fixed file table of a ring. */
+#define URING_FILES 1024
+
+/* Milliseconds the kernel thread polls an idle submission queue before it sleeps, with SQPOLL. */
+#define URING_SQPOLL_IDLE 100
+
+/* Size of the registered buffer arena, and of the smallest block it hands out. */
+#define URING_ARENA (64 * 1024 * 1024)
+#define URING_MIN_BLOCK 64
+
+/* Number of block sizes, doubling from URING_MIN_BLOCK. */
+#define URING_CLASSES 20
+
+/* Room at the start of a block for its size class, keeping data cache-aligned. */
+#define URING_HDR 64
+
+/* Largest number of bytes handed out by a single pop, so that a pop buffer fills a 64 KiB block. */
+#define URING_POP_SIZE (64 * 1024 - URING_HDR)
+
+/* User data of requests whose completion is ignored. */
+#define URING_IGNORE UINT64_MAX
+
+/* Milliseconds a ring being torn down waits for the kernel to give up its requests. */
+#define URING_DRAIN_MS 100
+
+/**
+ * @brief An asynchronous operation.
+ */
+struct uring_op {
+	demi_opcode_t opcode;           /**< Operation, DEMI_OPC_INVALID if the slot is free. */
+	int qd;                         /**< Target queue descriptor.                         */
+	int next;                       /**< Next operation of the same kind on this queue.   */
+	int inflight;                   /**< Non-zero while the kernel owns the operation.    */
+	int done;                       /**< Non-zero once the result is in @p res.           */
+	int orphan;                     /**< Non-zero if the queue was closed meanwhile.      */
+	int res;                        /**< Bytes transferred, new descriptor, or -errno.    */
+	demi_sgarray_t sga;             /**< Pushed scatter-gather array, or popped buffer.   */
+	size_t sent;                    /**< Number of bytes pushed so far.                   */
+	struct sockaddr_storage *addr;  /**< Peer address of a connect or accept.             */
+	socklen_t *addrlen;             /**< Length of @p addr, written by an accept.         */
+};
+
+/**
+ * @brief Per-queue ordering of pending operations.
+ */
+struct uring_queue {
+	int push_head; /**< Push in flight, -1 if none.             */
+	int push_tail; /**< Newest pending push, -1 if none.        */
+	int in_head;   /**< Pop/accept in flight, -1 if none.       */
+	int in_tail;   /**< Newest pending pop/accept, -1 if none.  */
+	int slot;      /**< Fixed file slot, -1 if not registered.  */
+};
+
+/**
+ * @brief A ring and the operations issued on it.
+ */
+struct uring {
+	int fd;                     /**< Ring file descriptor.                         */
+	void *rings;                /**< Mapping of both queue rings.                  */
+	size_t rings_size;          /**< Size of @p rings.                             */
+	struct io_uring_sqe *sqes;  /**< Submission queue entries.                     */
+	size_t sqes_size;           /**< Size of @p sqes.                              */
+	unsigned *sq_head;          /**< Consumed by the kernel.                       */
+	unsigned *sq_tail;          /**< Produced by us.                               */
+	unsigned *sq_flags;         /**< Ring flags, IORING_SQ_NEED_WAKEUP.            */
+	unsigned sq_mask;           /**< Index mask of the submission queue.           */
+	unsigned sq_entries;        /**< Capacity of the submission queue.             */
+	unsigned *cq_head;          /**< Consumed by us.                               */
+	unsigned *cq_tail;          /**< Produced by the kernel.                       */
+	unsigned cq_mask;           /**< Index mask of the completion queue.           */
+	struct io_uring_cqe *cqes;  /**< Completion queue entries.                     */
+	unsigned pending;           /**< Entries not yet handed to the kernel.         */
+	int sqpoll;                 /**< Non-zero if a kernel thread polls the queue.  */
+	int fixed_bufs;             /**< Non-zero if the arena is registered.          */
+	unsigned char *slots;       /**< Fixed file slots in use.                      */
+	struct uring_op *ops;       /**< Operations, indexed by token.                 */
+	int nops;                   /**< Capacity of @p ops.                           */
+	int free_op;                /**< Lowest slot of @p ops that may be free.       */
+	struct uring_queue *queues; /**< Queues, indexed by descriptor.                */
+	int nqueues;                /**< Capacity of @p queues.                        */
+};
+
+/**
+ * @brief Registered buffer arena, shared by all threads.
+ */
+static struct {
+	char *base;                  /**< Start of the arena, NULL if there is none.  */
+	size_t used;                 /**< Bytes handed out so far.                    */
+	void *free[URING_CLASSES];   /**< Released blocks of each size class.         */
+	pthread_mutex_t lock;        /**< Guards the above.                           */
+} arena = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* Ring of the calling thread. */
+static __thread struct uring *ring = NULL;
+
+/* Key under which the ring of each thread is torn down when it exits. */
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+int uring_sqpoll = 0;
+
+/*====================================================================================================================*
+ * Arena                                                                                                              *
+ *====================================================================================================================*/
+
+/**
+ * @brief Takes a block from the arena.
+ *
+ * @return A buffer of at least @p size bytes, or NULL if the arena cannot hold it.
+ */
+static void *arena_alloc(size_t size)
+{
+	unsigned c = 0;
+	char *block = NULL;
+
+	if (arena.base == NULL)
+		return (NULL);
+	while (c < URING_CLASSES && ((size_t)URING_MIN_BLOCK << c) < size + URING_HDR)
+		c++;
+	if (c == URING_CLASSES)
+		return (NULL);
+
+	pthread_mutex_lock(&arena.lock);
+	if (arena.free[c] != NULL)
+	{
+		block = arena.free[c];
+		arena.free[c] = *(void **)(block + URING_HDR);
+	}
+	else if (arena.used + ((size_t)URING_MIN_BLOCK << c) <= URING_ARENA)
+	{
+		block = arena.base + arena.used;
+		arena.used += (size_t)URING_MIN_BLOCK << c;
+	}
+	pthread_mutex_unlock(&arena.lock);
+
+	if (block == NULL)
+		return (NULL);
+	*(unsigned *)block = c;
+	return (block + URING_HDR);
+}
+
+/**
+ * @brief Checks whether a buffer was taken from the arena.
+ */
+static int arena_owns(const void *buf)
+{
+	return (arena.base != NULL && (const char *)buf >= arena.base && (const char *)buf < arena.base + URING_ARENA);
+}
+
+/**
+ * @brief Returns a block to the arena.
+ */
+static void arena_free(void *buf)
+{
+	char *block = (char *)buf - URING_HDR;
+	unsigned c = *(unsigned *)block;
+
+	pthread_mutex_lock(&arena.lock);
+	*(void **)buf = arena.free[c];
+	arena.free[c] = block;
+	pthread_mutex_unlock(&arena.lock);
+}
+
+/**
+ * @brief Takes a buffer from the arena, or from the heap if it does not fit.
+ */
+static void *buf_alloc(size_t size)
+{
+	void *buf = arena_alloc(size);
+
+	return ((buf != NULL) ? buf : malloc(size));
+}
+
+/**
+ * @brief Releases a buffer taken with buf_alloc().
+ */
+static void buf_free(void *buf)
+{
+	if (arena_owns(buf))
+		arena_free(buf);
+	else
+		free(buf);
+}
+
+/*====================================================================================================================*
+ * Ring                                                                                                               *
+ *====================================================================================================================*/
+
+static void uring_destroy(void *arg);
+
+/**
+ * @brief Creates the key under which the ring of each thread is torn down.
+ */
+static void ring_key_create(void)
+{
+	pthread_key_create(&ring_key, uring_destroy);
+}
+
+/**
+ * @brief Sets up the ring of the calling thread, if it has none yet.
+ *
+ * @return The ring, or NULL on failure with errno set.
+ */
+static struct uring *uring_get(void)
+{
+	struct io_uring_params p;
+	struct uring *r = NULL;
+	int *fds = NULL;
+	int err = 0;
+
+	if (ring != NULL)
+		return (ring);
+	if ((r = calloc(1, sizeof(struct uring))) == NULL)
+		return (NULL);
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_ENTRIES * URING_CQ_RATIO;
+	if (uring_sqpoll)
+	{
+		p.flags |= IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = URING_SQPOLL_IDLE;
+	}
+	if ((r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+		goto fail;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG))
+	{
+		errno = ENOTSUP;
+		goto fail;
+	}
+
+	/* Both rings share one mapping. */
+	r->rings_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	if (r->rings_size < p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe))
+		r->rings_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->rings = mmap(NULL, r->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+			IORING_OFF_SQ_RING);
+	if (r->rings == MAP_FAILED)
+		goto fail;
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+
+	r->sq_head = (unsigned *)((char *)r->rings + p.sq_off.head);
+	r->sq_tail = (unsigned *)((char *)r->rings + p.sq_off.tail);
+	r->sq_flags = (unsigned *)((char *)r->rings + p.sq_off.flags);
+	r->sq_mask = *(unsigned *)((char *)r->rings + p.sq_off.ring_mask);
+	r->sq_entries = p.sq_entries;
+	r->cq_head = (unsigned *)((char *)r->rings + p.cq_off.head);
+	r->cq_tail = (unsigned *)((char *)r->rings + p.cq_off.tail);
+	r->cq_mask = *(unsigned *)((char *)r->rings + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((char *)r->rings + p.cq_off.cqes);
+	r->sqpoll = uring_sqpoll;
+
+	/* Entry i of the submission queue always refers to submission queue entry i. */
+	for (unsigned i = 0; i < p.sq_entries; i++)
+		((unsigned *)((char *)r->rings + p.sq_off.array))[i] = i;
+
+	/* Empty fixed file table, filled in as sockets are opened. */
+	if ((fds = malloc(URING_FILES * sizeof(int))) == NULL || (r->slots = calloc(URING_FILES, 1)) == NULL)
+		goto fail;
+	for (unsigned i = 0; i < URING_FILES; i++)
+		fds[i] = -1;
+	if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES, fds, URING_FILES) != 0)
+		goto fail;
+	free(fds);
+	fds = NULL;
+
+	/* Without the arena registered, for instance over RLIMIT_MEMLOCK, buffers are still taken from it. */
+	if (arena.base != NULL)
+	{
+		struct iovec iov = {arena.base, URING_ARENA};
+
+		r->fixed_bufs = (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0);
+	}
+
+	pthread_once(&ring_once, ring_key_create);
+	pthread_setspecific(ring_key, r);
+	ring = r;
+	return (r);
+
+fail:
+	err = errno;
+	free(fds);
+	free(r->slots);
+	if (r->sqes != NULL && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_size);
+	if (r->rings != NULL && r->rings != MAP_FAILED)
+		munmap(r->rings, r->rings_size);
+	if (r->fd >= 0)
+		close(r->fd);
+	free(r);
+	errno = err;
+	return (NULL);
+}
+
+/**
+ * @brief Hands pending entries to the kernel, and optionally waits for a completion.
+ *
+ * @param r       Target ring.
+ * @param wait    Non-zero to wait for at least one completion.
+ * @param timeout Longest wait, NULL to wait forever.
+ *
+ * @return On success, zero is returned. On failure, an error code is returned instead, ETIME if the wait timed out.
+ */
+static int uring_enter(struct uring *r, int wait, const struct timespec *timeout)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	unsigned flags = 0;
+	unsigned submit = 0;
+	int ret = 0;
+
+	if (r->sqpoll)
+	{
+		/* The kernel thread sees new entries on its own, unless it went to sleep. */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+			flags |= IORING_ENTER_SQ_WAKEUP;
+	}
+	else
+		submit = r->pending;
+	if (wait)
+	{
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeout != NULL)
+		{
+			ts.tv_sec = timeout->tv_sec;
+			ts.tv_nsec = timeout->tv_nsec;
+			memset(&arg, 0, sizeof(arg));
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+		}
+	}
+	if (submit == 0 && flags == 0)
+		return (0);
+
+	ret = syscall(__NR_io_uring_enter, r->fd, submit, wait ? 1 : 0, flags,
+		      (flags & IORING_ENTER_EXT_ARG) ? (void *)&arg : NULL, sizeof(arg));
+	if (ret < 0)
+		return (errno);
+	if (!r->sqpoll)
+		r->pending -= ret;
+	return (0);
+}
+
+/**
+ * @brief Takes a free submission queue entry, handing pending ones to the kernel if the queue is full.
+ */
+static struct io_uring_sqe *uring_sqe(struct uring *r)
+{
+	unsigned tail = *r->sq_tail;
+	struct io_uring_sqe *sqe = NULL;
+
+	while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+	{
+		if (r->sqpoll)
+			syscall(__NR_io_uring_enter, r->fd, 0, 0, IORING_ENTER_SQ_WAKEUP | IORING_ENTER_SQ_WAIT, NULL, 0);
+		else
+			uring_enter(r, 0, NULL);
+	}
+	sqe = &r->sqes[tail & r->sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return (sqe);
+}
+
+/**
+ * @brief Publishes an entry taken with uring_sqe().
+ */
+static void uring_commit(struct uring *r)
+{
+	__atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+	if (!r->sqpoll)
+		r->pending++;
+}
+
+/**
+ * @brief Points an entry at a queue, through its fixed file slot if it has one.
+ */
+static void sqe_target(struct uring *r, struct io_uring_sqe *sqe, int qd)
+{
+	int slot = r->queues[qd].slot;
+
+	if (slot >= 0)
+	{
+		sqe->fd = slot;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	}
+	else
+		sqe->fd = qd;
+}
+
+/*====================================================================================================================*
+ * Operations                                                                                                         *
+ *====================================================================================================================*/
+
+/**
+ * @brief Returns the ordering state of a queue, growing the table if needed.
+ */
+static struct uring_queue *queue_of(struct uring *r, int qd)
+{
+	if (qd >= r->nqueues)
+	{
+		int n = (qd + 1) * 2;
+		struct uring_queue *q = realloc(r->queues, n * sizeof(struct uring_queue));
+
+		if (q == NULL)
+			return (NULL);
+		for (int i = r->nqueues; i < n; i++)
+			q[i] = (struct uring_queue){-1, -1, -1, -1, -1};
+		r->queues = q;
+		r->nqueues = n;
+	}
+	return (&r->queues[qd]);
+}
+
+/**
+ * @brief Sets up a new socket, installing it in a free fixed file slot if there is one.
+ *
+ * @return On success, zero is returned. On failure, an error code is returned instead.
+ */
+static int queue_add(struct uring *r, int fd)
+{
+	struct uring_queue *q = queue_of(r, fd);
+
+	if (q == NULL)
+		return (ENOMEM);
+	*q = (struct uring_queue){-1, -1, -1, -1, -1};
+	for (int i = 0; i < URING_FILES; i++)
+	{
+		struct io_uring_files_update up = {.offset = i, .fds = (uint64_t)(uintptr_t)&fd};
+
+		if (r->slots[i])
+			continue;
+		if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES_UPDATE, &up, 1) == 1)
+		{
+			r->slots[i] = 1;
+			q->slot = i;
+		}
+		break;
+	}
+	return (0);
+}
+
+/**
+ * @brief Removes a socket from the fixed file table.
+ */
+static void queue_remove(struct uring *r, int qd)
+{
+	struct uring_queue *q = &r->queues[qd];
+
+	if (q->slot >= 0)
+	{
+		int fd = -1;
+		struct io_uring_files_update up = {.offset = q->slot, .fds = (uint64_t)(uintptr_t)&fd};
+
+		syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES_UPDATE, &up, 1);
+		r->slots[q->slot] = 0;
+	}
+	*q = (struct uring_queue){-1, -1, -1, -1, -1};
+}
+
+/**
+ * @brief Takes a free operation slot.
+ */
+static int op_alloc(struct uring *r, demi_opcode_t opcode, int qd)
+{
+	int i;
+
+	for (i = r->free_op; i < r->nops && r->ops[i].opcode != DEMI_OPC_INVALID; i++)
+		;
+	if (i == r->nops)
+	{
+		int n = (r->nops == 0) ? 64 : r->nops * 2;
+		struct uring_op *o = realloc(r->ops, n * sizeof(struct uring_op));
+
+		if (o == NULL)
+			return (-1);
+		memset(o + r->nops, 0, (n - r->nops) * sizeof(struct uring_op));
+		r->ops = o;
+		r->nops = n;
+	}
+	r->free_op = i + 1;
+	memset(&r->ops[i], 0, sizeof(struct uring_op));
+	r->ops[i].opcode = opcode;
+	r->ops[i].qd = qd;
+	r->ops[i].next = -1;
+	return (i);
+}
+
+/**
+ * @brief Releases an operation slot, along with the buffers it still owns.
+ */
+static void op_release(struct uring *r, int i)
+{
+	struct uring_op *op = &r->ops[i];
+
+	if (op->opcode == DEMI_OPC_POP && op->sga.sga_buf != NULL)
+		buf_free(op->sga.sga_buf);
+	free(op->addr);
+	free(op->addrlen);
+	op->opcode = DEMI_OPC_INVALID;
+	if (i < r->free_op)
+		r->free_op = i;
+}
+
+/**
+ * @brief Hands an operation over to the kernel.
+ */
+static void op_submit(struct uring *r, int i)
+{
+	struct uring_op *op = &r->ops[i];
+	struct io_uring_sqe *sqe = uring_sqe(r);
+
+	sqe_target(r, sqe, op->qd);
+	sqe->user_data = i;
+	switch (op->opcode)
+	{
+	case DEMI_OPC_CONNECT:
+		sqe->opcode = IORING_OP_CONNECT;
+		sqe->addr = (uint64_t)(uintptr_t)op->addr;
+		sqe->off = *op->addrlen;
+		break;
+
+	case DEMI_OPC_ACCEPT:
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->addr = (uint64_t)(uintptr_t)op->addr;
+		sqe->addr2 = (uint64_t)(uintptr_t)op->addrlen;
+		break;
+
+	case DEMI_OPC_PUSH:
+	{
+		const demi_sgaseg_t *seg = &op->sga.sga_segs[0];
+
+		sqe->addr = (uint64_t)(uintptr_t)((const char *)seg->sgaseg_buf + op->sent);
+		sqe->len = seg->sgaseg_len - op->sent;
+		if (r->fixed_bufs && arena_owns(seg->sgaseg_buf))
+			sqe->opcode = IORING_OP_WRITE_FIXED;
+		else
+		{
+			sqe->opcode = IORING_OP_SEND;
+			sqe->msg_flags = MSG_NOSIGNAL;
+		}
+		break;
+	}
+
+	case DEMI_OPC_POP:
+		sqe->addr = (uint64_t)(uintptr_t)op->sga.sga_segs[0].sgaseg_buf;
+		sqe->len = URING_POP_SIZE;
+		sqe->opcode = (r->fixed_bufs && arena_owns(op->sga.sga_buf)) ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+		break;
+
+	default:
+		break;
+	}
+	uring_commit(r);
+	op->inflight = 1;
+}
+
+/**
+ * @brief Queues an operation behind those of the same kind on its queue, submitting it if it is first in line.
+ */
+static void op_enqueue(struct uring *r, int i, int *head, int *tail)
+{
+	if (*tail >= 0)
+		r->ops[*tail].next = i;
+	else
+		*head = i;
+	*tail = i;
+	if (*head == i)
+		op_submit(r, i);
+}
+
+/**
+ * @brief Removes the operation in flight on a queue, and submits the next one.
+ */
+static void op_dequeue(struct uring *r, int *head, int *tail)
+{
+	*head = r->ops[*head].next;
+	if (*head < 0)
+		*tail = -1;
+	else
+		op_submit(r, *head);
+}
+
+/**
+ * @brief Accounts for a completion.
+ */
+static void op_complete(struct uring *r, uint64_t user_data, int res)
+{
+	struct uring_op *op = NULL;
+	struct uring_queue *q = NULL;
+	int i = (int)user_data;
+
+	if (user_data == URING_IGNORE)
+		return;
+	op = &r->ops[i];
+	op->inflight = 0;
+	if (op->orphan)
+	{
+		if (op->opcode == DEMI_OPC_ACCEPT && res >= 0)
+			close(res);
+		op_release(r, i);
+		return;
+	}
+	q = &r->queues[op->qd];
+
+	switch (op->opcode)
+	{
+	case DEMI_OPC_PUSH:
+		/* Push whatever a short write left over. */
+		if (res > 0 && op->sent + res < op->sga.sga_segs[0].sgaseg_len)
+		{
+			op->sent += res;
+			op_submit(r, i);
+			return;
+		}
+		op_dequeue(r, &q->push_head, &q->push_tail);
+		break;
+
+	case DEMI_OPC_ACCEPT:
+		if (res >= 0)
+		{
+			int err = queue_add(r, res);
+
+			if (err != 0)
+			{
+				close(res);
+				res = -err;
+			}
+			else
+				setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+			/* The table may have moved. */
+			op = &r->ops[i];
+			q = &r->queues[op->qd];
+		}
+		op_dequeue(r, &q->in_head, &q->in_tail);
+		break;
+
+	case DEMI_OPC_POP:
+		op_dequeue(r, &q->in_head, &q->in_tail);
+		break;
+
+	default:
+		break;
+	}
+	op = &r->ops[i];
+	op->res = res;
+	op->done = 1;
+}
+
+/**
+ * @brief Accounts for every completion posted so far.
+ */
+static void uring_reap(struct uring *r)
+{
+	unsigned head = *r->cq_head;
+
+	while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+		uint64_t user_data = cqe->user_data;
+		int res = cqe->res;
+
+		/* Free the entry first, since handling the completion may submit more. */
+		__atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+		op_complete(r, user_data, res);
+		head = *r->cq_head;
+	}
+}
+
+/**
+ * @brief Hands a completed operation over to the caller.
+ */
+static void op_result(struct uring *r, int i, demi_qresult_t *qr)
+{
+	struct uring_op *op = &r->ops[i];
+
+	memset(qr, 0, sizeof(demi_qresult_t));
+	qr->qr_qd = op->qd;
+	qr->qr_qt = i;
+	qr->qr_opcode = op->opcode;
+	if (op->res < 0)
+	{
+		qr->qr_opcode = DEMI_OPC_FAILED;
+		qr->qr_ret = -op->res;
+	}
+	else if (op->opcode == DEMI_OPC_ACCEPT)
+	{
+		qr->qr_value.ares.qd = op->res;
+		memcpy(&qr->qr_value.ares.addr, op->addr, sizeof(qr->qr_value.ares.addr));
+	}
+	else if (op->opcode == DEMI_OPC_PUSH)
+		qr->qr_value.sga = op->sga;
+	else if (op->opcode == DEMI_OPC_POP)
+	{
+		/* The buffer is handed over, as is, with the number of bytes received. */
+		qr->qr_value.sga = op->sga;
+		qr->qr_value.sga.sga_segs[0].sgaseg_len = op->res;
+		op->sga.sga_buf = NULL;
+	}
+	op_release(r, i);
+}
+
+/**
+ * @brief Issues an operation on the calling thread's ring.
+ *
+ * @param qt_out Storage location for the token of the operation.
+ * @param opcode Operation.
+ * @param qd     Target queue descriptor.
+ * @param sga    Scatter-gather array to push, NULL for other operations.
+ * @param addr   Remote address to connect to, NULL for other operations.
+ * @param size   Size of @p addr.
+ *
+ * @return On success, zero is returned. On failure, an error code is returned instead.
+ */
+static int op_issue(demi_qtoken_t *qt_out, demi_opcode_t opcode, int qd, const demi_sgarray_t *sga,
+		    const struct sockaddr *addr, socklen_t size)
+{
+	struct uring *r = uring_get();
+	struct uring_queue *q = NULL;
+	struct uring_op *op = NULL;
+	int i = -1;
+
+	if (r == NULL)
+		return (errno);
+	if (qd < 0 || qd >= r->nqueues)
+		return (EBADF);
+	if ((i = op_alloc(r, opcode, qd)) < 0)
+		return (ENOMEM);
+	q = &r->queues[qd];
+	op = &r->ops[i];
+
+	switch (opcode)
+	{
+	case DEMI_OPC_CONNECT:
+	case DEMI_OPC_ACCEPT:
+		op->addr = calloc(1, sizeof(struct sockaddr_storage));
+		op->addrlen = malloc(sizeof(socklen_t));
+		if (op->addr == NULL || op->addrlen == NULL || size > sizeof(struct sockaddr_storage))
+		{
+			op_release(r, i);
+			return (ENOMEM);
+		}
+		*op->addrlen = (opcode == DEMI_OPC_CONNECT) ? size : sizeof(struct sockaddr_storage);
+		if (opcode == DEMI_OPC_CONNECT)
+		{
+			memcpy(op->addr, addr, size);
+			op_submit(r, i);
+		}
+		else
+			op_enqueue(r, i, &q->in_head, &q->in_tail);
+		break;
+
+	case DEMI_OPC_PUSH:
+		op->sga = *sga;
+		op_enqueue(r, i, &q->push_head, &q->push_tail);
+		break;
+
+	case DEMI_OPC_POP:
+	{
+		void *buf = buf_alloc(URING_POP_SIZE);
+
+		if (buf == NULL)
+		{
+			op_release(r, i);
+			return (ENOMEM);
+		}
+		op->sga.sga_buf = buf;
+		op->sga.sga_numsegs = 1;
+		op->sga.sga_segs[0].sgaseg_buf = buf;
+		op->sga.sga_segs[0].sgaseg_len = URING_POP_SIZE;
+		op_enqueue(r, i, &q->in_head, &q->in_tail);
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	*qt_out = i;
+	return (0);
+}
+
+/**
+ * @brief Tears down a ring, once the kernel is done with its requests. Its sockets are left open.
+ *
+ * @param arg Target ring.
+ */
+static void uring_destroy(void *arg)
+{
+	struct uring *r = arg;
+	const struct timespec tick = {0, 1000000};
+
+	/* Cancel what the kernel still owns, so that it stops writing to buffers about to be released. */
+	for (int i = 0; i < r->nops; i++)
+	{
+		struct uring_op *op = &r->ops[i];
+
+		if (op->opcode != DEMI_OPC_INVALID && op->inflight && !op->orphan)
+		{
+			struct io_uring_sqe *sqe = uring_sqe(r);
+
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = i;
+			sqe->user_data = URING_IGNORE;
+			uring_commit(r);
+			op->orphan = 1;
+		}
+	}
+	for (int ms = 0; ms < URING_DRAIN_MS; ms++)
+	{
+		int inflight = 0;
+
+		uring_reap(r);
+		for (int i = 0; i < r->nops; i++)
+			inflight += (r->ops[i].opcode != DEMI_OPC_INVALID && r->ops[i].inflight);
+		if (inflight == 0)
+			break;
+		uring_enter(r, 1, &tick);
+	}
+
+	/* Buffers of requests that would not give up are leaked rather than reused under the kernel's feet. */
+	for (int i = 0; i < r->nops; i++)
+	{
+		if (r->ops[i].opcode != DEMI_OPC_INVALID && !r->ops[i].inflight)
+			op_release(r, i);
+	}
+	close(r->fd);
+	munmap(r->sqes, r->sqes_size);
+	munmap(r->rings, r->rings_size);
+	free(r->slots);
+	free(r->ops);
+	free(r->queues);
+	free(r);
+	if (ring == r)
+		ring = NULL;
+}
+
+/*====================================================================================================================*
+ * Queue API                                                                                                          *
+ *====================================================================================================================*/
+
+static int uring_init(int argc, char *const argv[])
+{
+	void *base = NULL;
+
+	(void)argc;
+	(void)argv;
+
+	/* WRITE_FIXED has no MSG_NOSIGNAL: writing to a reset connection must fail rather than kill the process. */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Without an arena, buffers come from the heap and are not registered. */
+	base = mmap(NULL, URING_ARENA, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	arena.base = (base != MAP_FAILED) ? base : NULL;
+
+	/* Check that io_uring is there at all. */
+	return ((uring_get() != NULL) ? 0 : errno);
+}
+
+static int uring_socket(int *sockqd_out, int domain, int type, int protocol)
+{
+	struct uring *r = uring_get();
+	int fd = -1;
+	int err = 0;
+
+	if (r == NULL)
+		return (errno);
+	if ((fd = socket(domain, type, protocol)) < 0)
+		return (errno);
+	if ((err = queue_add(r, fd)) != 0)
+	{
+		close(fd);
+		return (err);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+	*sockqd_out = fd;
+	return (0);
+}
+
+static int uring_bind(int sockqd, const struct sockaddr *addr, socklen_t size)
+{
+	return ((bind(sockqd, addr, size) == 0) ? 0 : errno);
+}
+
+static int uring_listen(int sockqd, int backlog)
+{
+	return ((listen(sockqd, backlog) == 0) ? 0 : errno);
+}
+
+static int uring_accept(demi_qtoken_t *qt_out, int sockqd)
+{
+	return (op_issue(qt_out, DEMI_OPC_ACCEPT, sockqd, NULL, NULL, 0));
+}
+
+static int uring_connect(demi_qtoken_t *qt_out, int sockqd, const struct sockaddr *addr, socklen_t size)
+{
+	return (op_issue(qt_out, DEMI_OPC_CONNECT, sockqd, NULL, addr, size));
+}
+
+static int uring_close(int qd)
+{
+	struct uring *r = uring_get();
+
+	if (r == NULL)
+		return (errno);
+
+	/* Cancel what the kernel still owns, and forget about the rest. */
+	for (int i = 0; qd < r->nqueues && i < r->nops; i++)
+	{
+		struct uring_op *op = &r->ops[i];
+
+		if (op->opcode == DEMI_OPC_INVALID || op->qd != qd || op->orphan)
+			continue;
+		if (op->inflight)
+		{
+			struct io_uring_sqe *sqe = uring_sqe(r);
+
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = i;
+			sqe->user_data = URING_IGNORE;
+			uring_commit(r);
+			op->orphan = 1;
+		}
+		else
+			op_release(r, i);
+	}
+	if (qd < r->nqueues)
+		queue_remove(r, qd);
+
+	/* Requests that were already running see the end of the connection. */
+	shutdown(qd, SHUT_RDWR);
+	return ((close(qd) == 0) ? 0 : errno);
+}
+
+static int uring_push(demi_qtoken_t *qt_out, int qd, const demi_sgarray_t *sga)
+{
+	return (op_issue(qt_out, DEMI_OPC_PUSH, qd, sga, NULL, 0));
+}
+
+static int uring_pop(demi_qtoken_t *qt_out, int qd)
+{
+	return (op_issue(qt_out, DEMI_OPC_POP, qd, NULL, NULL, 0));
+}
+
+static int uring_wait_any(demi_qresult_t *qr_out, int *ready_offset, const demi_qtoken_t qts[], int num_qts,
+			  const struct timespec *timeout)
+{
+	struct uring *r = uring_get();
+	struct timespec deadline;
+	int last = 0;
+
+	if (r == NULL)
+		return (errno);
+	if (timeout != NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	for (;;)
+	{
+		struct timespec left;
+		int err = 0;
+
+		uring_reap(r);
+		for (int k = 0; k < num_qts; k++)
+		{
+			if (qts[k] >= (demi_qtoken_t)r->nops || r->ops[qts[k]].opcode == DEMI_OPC_INVALID ||
+			    r->ops[qts[k]].orphan)
+				return (EINVAL);
+			if (r->ops[qts[k]].done)
+			{
+				op_result(r, qts[k], qr_out);
+				*ready_offset = k;
+				return (0);
+			}
+		}
+		if (last)
+			return (ETIMEDOUT);
+
+		if (timeout != NULL)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &left);
+			left.tv_sec = deadline.tv_sec - left.tv_sec;
+			left.tv_nsec = deadline.tv_nsec - left.tv_nsec;
+			if (left.tv_nsec < 0)
+			{
+				left.tv_sec--;
+				left.tv_nsec += 1000000000;
+			}
+
+			/* Out of time: hand over what is pending and look at the completion queue one last time. */
+			if (left.tv_sec < 0 || (left.tv_sec == 0 && left.tv_nsec == 0))
+			{
+				if ((err = uring_enter(r, 0, NULL)) != 0)
+					return (err);
+				last = 1;
+				continue;
+			}
+		}
+		err = uring_enter(r, 1, (timeout != NULL) ? &left : NULL);
+		if (err != 0 && err != ETIME && err != EINTR && err != EBUSY)
+			return (err);
+	}
+}
+
+static demi_sgarray_t uring_sgaalloc(size_t size)
+{
+	demi_sgarray_t sga = {0};
+	void *buf = buf_alloc(size);
+
+	if (buf == NULL)
+		return (sga);
+	sga.sga_buf = buf;
+	sga.sga_numsegs = 1;
+	sga.sga_segs[0].sgaseg_buf = buf;
+	sga.sga_segs[0].sgaseg_len = size;
+	return (sga);
+}
+
+static int uring_sgafree(demi_sgarray_t *sga)
+{
+	buf_free(sga->sga_buf);
+	sga->sga_buf = NULL;
+	return (0);
+}
+
+static void uring_fini(void)
+{
+	/* Rings of other threads went with them. */
+	if (ring != NULL)
+	{
+		pthread_setspecific(ring_key, NULL);
+		uring_destroy(ring);
+	}
+
+	if (arena.base != NULL)
+		munmap(arena.base, URING_ARENA);
+	arena.base = NULL;
+	arena.used = 0;
+	memset(arena.free, 0, sizeof(arena.free));
+}
+
+/**
+ * @brief io_uring, with fixed files and registered buffers.
+ */
+const struct transport transport_uring = {
+	.name = "io_uring",
+	.init = uring_init,
+	.socket = uring_socket,
+	.bind = uring_bind,
+	.listen = uring_listen,
+	.accept = uring_accept,
+	.connect = uring_connect,
+	.close = uring_close,
+	.push = uring_push,
+	.pop = uring_pop,
+	.wait_any = uring_wait_any,
+	.sgaalloc = uring_sgaalloc,
+	.sgafree = uring_sgafree,
+	.fini = uring_fini,
+};
+
+/**
+ * @brief Checks whether the ring of the calling thread has the arena registered.
+ *
+ * @return Non-zero if pushes and pops go through WRITE_FIXED and READ_FIXED, zero if they fall back to SEND and
+ * RECV or if the thread has no ring.
+ */
+int uring_fixed_buffers(void)
+{
+	return (ring != NULL && ring->fixed_bufs);
+}